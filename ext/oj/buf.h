@@ -4,19 +4,32 @@
 #ifndef OJ_BUF_H
 #define OJ_BUF_H
 
+#include <setjmp.h>
+#include <stdlib.h>
+
 #include "ruby.h"
 
 typedef struct _buf {
     char *head;
     char *end;
     char *tail;
-    char  base[1024];
+    // Set for a buffer that grows with malloc so it can be used on a thread
+    // not known to Ruby. A failure to grow jumps to *jump or raises if that is
+    // NULL.
+    jmp_buf **jump;
+    char      base[1024];
 } * Buf;
 
 inline static void buf_init(Buf buf) {
     buf->head = buf->base;
     buf->end  = buf->base + sizeof(buf->base) - 1;
     buf->tail = buf->head;
+    buf->jump = NULL;
+}
+
+inline static void buf_init_malloc(Buf buf, jmp_buf **jump) {
+    buf_init(buf);
+    buf->jump = jump;
 }
 
 inline static void buf_reset(Buf buf) {
@@ -25,7 +38,11 @@ inline static void buf_reset(Buf buf) {
 
 inline static void buf_cleanup(Buf buf) {
     if (buf->base != buf->head) {
-        xfree(buf->head);
+        if (NULL == buf->jump) {
+            xfree(buf->head);
+        } else {
+            free(buf->head);
+        }
     }
 }
 
@@ -38,24 +55,45 @@ inline static const char *buf_str(Buf buf) {
     return buf->head;
 }
 
+inline static void buf_grow(Buf buf, size_t slen) {
+    size_t len     = buf->end - buf->head;
+    size_t toff    = buf->tail - buf->head;
+    size_t new_len = len + slen + len / 2;
+
+    if (NULL != buf->jump) {
+        char *head;
+
+        if (buf->base == buf->head) {
+            if (NULL != (head = (char *)malloc(new_len))) {
+                memcpy(head, buf->base, len);
+            }
+        } else {
+            head = (char *)realloc(buf->head, new_len);
+        }
+        if (NULL == head) {
+            if (NULL == *buf->jump) {
+                rb_raise(rb_eNoMemError, "failed to grow a buffer");
+            }
+            longjmp(**buf->jump, 1);
+        }
+        buf->head = head;
+    } else if (buf->base == buf->head) {
+        buf->head = ALLOC_N(char, new_len);
+        memcpy(buf->head, buf->base, len);
+    } else {
+        REALLOC_N(buf->head, char, new_len);
+    }
+    buf->tail = buf->head + toff;
+    buf->end  = buf->head + new_len - 1;
+}
+
 inline static void buf_append_string(Buf buf, const char *s, size_t slen) {
     if (0 == slen) {
         return;
     }
 
     if (buf->end <= buf->tail + slen) {
-        size_t len     = buf->end - buf->head;
-        size_t toff    = buf->tail - buf->head;
-        size_t new_len = len + slen + len / 2;
-
-        if (buf->base == buf->head) {
-            buf->head = ALLOC_N(char, new_len);
-            memcpy(buf->head, buf->base, len);
-        } else {
-            REALLOC_N(buf->head, char, new_len);
-        }
-        buf->tail = buf->head + toff;
-        buf->end  = buf->head + new_len - 1;
+        buf_grow(buf, slen);
     }
     memcpy(buf->tail, s, slen);
     buf->tail += slen;
@@ -63,18 +101,7 @@ inline static void buf_append_string(Buf buf, const char *s, size_t slen) {
 
 inline static void buf_append(Buf buf, char c) {
     if (buf->end <= buf->tail) {
-        size_t len     = buf->end - buf->head;
-        size_t toff    = buf->tail - buf->head;
-        size_t new_len = len + len / 2;
-
-        if (buf->base == buf->head) {
-            buf->head = ALLOC_N(char, new_len);
-            memcpy(buf->head, buf->base, len);
-        } else {
-            REALLOC_N(buf->head, char, new_len);
-        }
-        buf->tail = buf->head + toff;
-        buf->end  = buf->head + new_len - 1;
+        buf_grow(buf, 0);
     }
     *buf->tail = c;
     buf->tail++;
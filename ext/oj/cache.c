@@ -7,14 +7,24 @@
 #include <stdlib.h>
 
 #include "cache.h"
+#include "simd.h"
 
 // The stdlib calloc, realloc, and free are used instead of the Ruby ALLOC,
 // ALLOC_N, REALLOC, and xfree since the later could trigger a GC which will
 // either corrupt memory or if the mark function locks will deadlock.
 
-#define REHASH_LIMIT 4
-#define MIN_SHIFT 8
-#define REUSE_MAX 8192
+#define MIN_SIZE 256
+#define MIN_DICT_SIZE 16
+#define MAX_DISP 65536
+#define DROPPED UINT64_MAX
+#define GROUP 16
+#define KEY_BLOCK 16384
+// Longer keys are not cached. They are rarely repeated.
+#define CACHE_MAX_LEN 1024
+
+// Control bytes. A full entry has the top 7 bits of the hash.
+#define EMPTY 0x80
+#define H2(h) ((uint8_t)((h) >> 57))
 
 #if HAVE_PTHREAD_MUTEX_INIT
 #define CACHE_LOCK(c) pthread_mutex_lock(&((c)->mutex))
@@ -24,34 +34,112 @@
 #define CACHE_UNLOCK(c) rb_mutex_unlock((c)->mutex)
 #endif
 
+// Support for compaction. The cached values are not pinned so GC.compact
+// can move them. cache_compact() then picks up the new locations.
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+#define mark_value(v) rb_gc_mark_movable(v)
+#else
+#define mark_value(v) rb_gc_mark(v)
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define FENCE_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define ADD_RELAXED(p) __atomic_fetch_add((p), 1, __ATOMIC_RELAXED)
+#define CTZ(x) __builtin_ctz(x)
+#else
+#define LOAD_ACQUIRE(p) (*(p))
+#define STORE_RELEASE(p, v) (*(p) = (v))
+#define FENCE_ACQUIRE()
+#define ADD_RELAXED(p) ((*(p))++)
+static int CTZ(uint32_t x) {
+    int n = 0;
+
+    for (; 0 == (x & 1); x >>= 1) {
+        n++;
+    }
+    return n;
+}
+#endif
+
 // almost the Murmur hash algorithm
 #define M 0x5bd1e995
 
-typedef struct _slot {
-    struct _slot *    next;
+// The table uses open addressing with a control byte per entry in the style
+// of a Swiss table. A group of 16 control bytes is compared at once to find
+// the entries that might match so most misses never touch an entry. Entries
+// are 32 bytes so two fit in a cache line and the key bytes are kept apart
+// in blocks owned by the table.
+//
+// Each GC starts a new epoch and an entry records the epoch it was last
+// used in. Entries that have not been used for a number of epochs set by
+// the expunge rate are dropped when the table fills up and is copied. The
+// GC mark then only has to mark the values.
+typedef struct _entry {
     VALUE             val;
+    const char *      key;
     uint64_t          hash;
-    volatile uint32_t use_cnt;
-    uint8_t           klen;
-    char              key[CACHE_MAX_KEY];
-} * Slot;
+    uint32_t          klen;
+    volatile uint32_t epoch;  // epoch of the last use
+} * Entry;
+
+typedef struct _block {
+    struct _block *next;
+    size_t         len;
+    size_t         cap;
+    char           bytes[];
+} * Block;
+
+typedef struct _table {
+    uint64_t       size;  // a multiple of GROUP
+    uint64_t       mask;
+    uint64_t       cnt;
+    Entry          entries;
+    Block          keys;
+    struct _table *next;  // next retired table
+    uint8_t        ctrl[];
+} * Table;
+
+// Registered keys are kept in a dictionary that is checked before the
+// table. The dictionary uses a perfect hash built when keys are registered.
+// Keys are spread over buckets by the low bits of the hash and each bucket
+// has a displacement, picked during the build, that sends each of its keys
+// to a slot no other key uses. A lookup is then one bucket read and one
+// entry compare. Dictionary entries are never expunged.
+typedef struct _dict {
+    uint64_t      size;  // number of slots, a power of two
+    uint64_t      bmask;
+    uint64_t      cnt;
+    int           shift;
+    uint32_t *    disp;     // displacement for each bucket
+    Entry         entries;  // the key is NULL for an empty slot
+    Block         keys;
+    struct _dict *next;  // next retired dictionary
+} * Dict;
 
 typedef struct _cache {
-    volatile Slot * slots;
-    volatile size_t cnt;
+    volatile Table table;
+    Table          retired;  // replaced tables waiting to be freed
+    volatile Dict  dict;     // NULL if no keys are registered
+    Dict           retired_dicts;
     VALUE (*form)(const char *str, size_t len);
-    uint64_t size;
-    uint64_t mask;
     VALUE (*intern)(struct _cache *c, const char *key, size_t len);
-    volatile Slot reuse;
-    size_t        rcnt;
 #if HAVE_PTHREAD_MUTEX_INIT
     pthread_mutex_t mutex;
 #else
     VALUE mutex;
 #endif
-    uint8_t xrate;
-    bool    mark;
+    volatile uint32_t epoch;
+    // Counters for cache_stats(). The hit and miss counters of a locking
+    // cache are relaxed atomics since lookups are not locked.
+    uint64_t          hits;
+    uint64_t          misses;
+    uint64_t          rehashes;
+    uint64_t          expunged;
+    uint8_t           xrate;
+    bool              mark;
+    bool              locking;
 } * Cache;
 
 void cache_set_form(Cache c, VALUE (*form)(const char *str, size_t len)) {
@@ -92,135 +180,405 @@ static uint64_t hash_calc(const uint8_t *key, size_t len) {
     return h;
 }
 
-static void rehash(Cache c) {
-    uint64_t osize;
-    Slot *   end;
-    Slot *   sp;
-
-    osize    = c->size;
-    c->size  = osize * 4;
-    c->mask  = c->size - 1;
-    c->slots = realloc((void *)c->slots, sizeof(Slot) * c->size);
-    memset((Slot *)c->slots + osize, 0, sizeof(Slot) * osize * 3);
-    end = (Slot *)c->slots + osize;
-    for (sp = (Slot *)c->slots; sp < end; sp++) {
-        Slot s    = *sp;
-        Slot next = NULL;
-
-        *sp = NULL;
-        for (; NULL != s; s = next) {
-            uint64_t h      = s->hash & c->mask;
-            Slot *   bucket = (Slot *)c->slots + h;
-
-            next    = s->next;
-            s->next = *bucket;
-            *bucket = s;
+// A new slot array is built on each rehash. The slots are moved to the new
+// array and the new array is then published so a reader sees either the old
+// array or the complete new one. Moving a slot can divert a reader walking a
+// bucket of the old array. That is only a miss which is then checked again
+// under the lock. The old array is retired instead of freed since a reader
+// might still have it. Retired arrays are freed in cache_mark() since the GC
+// never runs while a reader is in the middle of a lookup.
+// Bit i of the result is set if control byte i of the group is b.
+inline static uint32_t group_match(const uint8_t *ctrl, uint8_t b) {
+#if OJ_X86_SIMD
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)b)));
+#else
+    uint32_t m = 0;
+    int      i;
+
+    for (i = 0; i < GROUP; i++) {
+        if (b == ctrl[i]) {
+            m |= 1U << i;
         }
     }
+    return m;
+#endif
 }
 
-static VALUE lockless_intern(Cache c, const char *key, size_t len) {
-    uint64_t       h      = hash_calc((const uint8_t *)key, len);
-    Slot *         bucket = (Slot *)c->slots + (h & c->mask);
-    Slot           b;
-    volatile VALUE rkey;
+// Bit i of the result is set if entry i of the group is full.
+inline static uint32_t group_full(const uint8_t *ctrl) {
+#if OJ_X86_SIMD
+    return ~(uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl)) & 0xFFFF;
+#else
+    uint32_t m = 0;
+    int      i;
 
-    while (REUSE_MAX < c->rcnt) {
-        if (NULL != (b = c->reuse)) {
-            c->reuse = b->next;
-            free(b);
-            c->rcnt--;
-        } else {
-            // An accounting error occured somewhere so correct it.
-            c->rcnt = 0;
+    for (i = 0; i < GROUP; i++) {
+        if (0 == (0x80 & ctrl[i])) {
+            m |= 1U << i;
         }
     }
-    for (b = *bucket; NULL != b; b = b->next) {
-        if ((uint8_t)len == b->klen && 0 == strncmp(b->key, key, len)) {
-            b->use_cnt += 16;
-            return b->val;
+    return m;
+#endif
+}
+
+static Table table_new(uint64_t size) {
+    Table t = calloc(1, sizeof(struct _table) + size);
+
+    t->size    = size;
+    t->mask    = size - 1;
+    t->entries = calloc(size, sizeof(struct _entry));
+    memset(t->ctrl, EMPTY, size);
+
+    return t;
+}
+
+static void table_free(Table t) {
+    Block b;
+
+    while (NULL != (b = t->keys)) {
+        t->keys = b->next;
+        free(b);
+    }
+    free(t->entries);
+    free(t);
+}
+
+static const char *key_copy(Block *keys, const char *key, size_t len) {
+    Block b = *keys;
+    char *k;
+
+    if (NULL == b || b->cap - b->len < len) {
+        size_t cap = (len < KEY_BLOCK) ? KEY_BLOCK : len;
+
+        b       = malloc(sizeof(struct _block) + cap);
+        b->len  = 0;
+        b->cap  = cap;
+        b->next = *keys;
+        *keys   = b;
+    }
+    k = b->bytes + b->len;
+    memcpy(k, key, len);
+    b->len += len;
+
+    return k;
+}
+
+// Groups are probed in a triangular sequence which visits every group since
+// the number of groups is a power of two. A probe ends at the first group
+// with an empty entry.
+static Entry find(Table t, uint64_t h, const char *key, size_t len) {
+    uint64_t g = h & t->mask & ~(uint64_t)(GROUP - 1);
+    uint64_t step;
+
+    for (step = GROUP;; step += GROUP) {
+        uint32_t m = group_match(t->ctrl + g, H2(h));
+
+        if (0 != m) {
+            // Pairs with the release store of the control byte in put().
+            FENCE_ACQUIRE();
+            for (; 0 != m; m &= m - 1) {
+                Entry e = t->entries + g + CTZ(m);
+
+                if (e->hash == h && e->klen == len && 0 == memcmp(e->key, key, len)) {
+                    return e;
+                }
+            }
         }
+        if (0 != group_match(t->ctrl + g, EMPTY)) {
+            return NULL;
+        }
+        g = (g + step) & t->mask;
     }
-    rkey = c->form(key, len);
-    if (NULL == (b = c->reuse)) {
-        b = calloc(1, sizeof(struct _slot));
+}
+
+// Adds an entry for a key known not to be in the table. The entry is filled
+// in before the control byte is set so a reader never sees a partial entry.
+static void put(Table t, uint64_t h, const char *key, size_t len, VALUE val, uint32_t epoch) {
+    uint64_t g = h & t->mask & ~(uint64_t)(GROUP - 1);
+    uint64_t step;
+    uint32_t m;
+    Entry    e;
+
+    for (step = GROUP; 0 == (m = group_match(t->ctrl + g, EMPTY)); step += GROUP) {
+        g = (g + step) & t->mask;
+    }
+    g += CTZ(m);
+    e        = t->entries + g;
+    e->val   = val;
+    e->key   = key_copy(&t->keys, key, len);
+    e->hash  = h;
+    e->klen  = (uint32_t)len;
+    e->epoch = epoch;
+    t->cnt++;
+    STORE_RELEASE(t->ctrl + g, H2(h));
+}
+
+inline static uint64_t dict_slot(Dict d, uint64_t h, uint32_t disp) {
+    return ((h ^ ((uint64_t)disp * 0x9E3779B97F4A7C15ULL)) * 0xFF51AFD7ED558CCDULL) >> d->shift;
+}
+
+inline static Entry dict_find(Dict d, uint64_t h, const char *key, size_t len) {
+    Entry e = d->entries + dict_slot(d, h, d->disp[h & d->bmask]);
+
+    if (e->hash == h && e->klen == len && NULL != e->key && 0 == memcmp(e->key, key, len)) {
+        return e;
+    }
+    return NULL;
+}
+
+static void dict_free(Dict d) {
+    Block b;
+
+    while (NULL != (b = d->keys)) {
+        d->keys = b->next;
+        free(b);
+    }
+    free(d->entries);
+    free(d->disp);
+    free(d);
+}
+
+// Looks for a displacement that puts each of the n entries of bucket b in a
+// free slot of its own.
+static bool dict_place(Dict d, Entry src, uint64_t *idx, uint64_t n, uint64_t b, uint64_t *slots) {
+    uint32_t disp;
+    uint64_t i;
+    uint64_t j;
+
+    for (disp = 0; disp < MAX_DISP; disp++) {
+        for (i = 0; i < n; i++) {
+            if (DROPPED == idx[i]) {
+                continue;
+            }
+            slots[i] = dict_slot(d, src[idx[i]].hash, disp);
+            if (NULL != d->entries[slots[i]].key) {
+                break;
+            }
+            for (j = 0; j < i; j++) {
+                if (DROPPED != idx[j] && slots[j] == slots[i]) {
+                    break;
+                }
+            }
+            if (j < i) {
+                break;
+            }
+        }
+        if (i < n) {
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            if (DROPPED != idx[i]) {
+                Entry e = d->entries + slots[i];
+
+                *e     = src[idx[i]];
+                e->key = key_copy(&d->keys, e->key, e->klen);
+                d->cnt++;
+            }
+        }
+        d->disp[b] = disp;
+        return true;
+    }
+    return false;
+}
+
+// Builds a dictionary with size slots from the cnt entries in src. Only the
+// first of the entries with the same hash is kept. A later duplicate key is
+// not needed and a different key with the same hash is left to the table.
+// The largest buckets are placed first while most slots are still free. NULL
+// is returned if a bucket could not be placed so the caller can try again
+// with more slots.
+static Dict dict_new(Entry src, uint64_t cnt, uint64_t size) {
+    Dict      d       = calloc(1, sizeof(struct _dict));
+    uint64_t  buckets = 1;
+    uint64_t  max     = 0;
+    uint64_t *starts;
+    uint64_t *fill;
+    uint64_t *idx;
+    uint64_t *slots;
+    uint64_t  b;
+    uint64_t  i;
+    uint64_t  j;
+    uint64_t  n;
+    bool      ok = true;
+
+    while (buckets * 4 < cnt) {
+        buckets *= 2;
+    }
+    d->size  = size;
+    d->bmask = buckets - 1;
+    d->shift = 64;
+    for (i = 1; i < size; i *= 2) {
+        d->shift--;
+    }
+    d->disp    = calloc(buckets, sizeof(uint32_t));
+    d->entries = calloc(size, sizeof(struct _entry));
+
+    // Group the entries by bucket with a counting sort.
+    starts = calloc(buckets + 1, sizeof(uint64_t));
+    fill   = malloc(sizeof(uint64_t) * buckets);
+    idx    = malloc(sizeof(uint64_t) * (cnt + 1));
+    for (i = 0; i < cnt; i++) {
+        starts[(src[i].hash & d->bmask) + 1]++;
+    }
+    for (b = 0; b < buckets; b++) {
+        if (max < starts[b + 1]) {
+            max = starts[b + 1];
+        }
+        starts[b + 1] += starts[b];
+        fill[b] = starts[b];
+    }
+    for (i = 0; i < cnt; i++) {
+        idx[fill[src[i].hash & d->bmask]++] = i;
+    }
+    free(fill);
+    for (b = 0; b < buckets; b++) {
+        for (i = starts[b] + 1; i < starts[b + 1]; i++) {
+            for (j = starts[b]; j < i; j++) {
+                if (DROPPED != idx[j] && src[idx[j]].hash == src[idx[i]].hash) {
+                    idx[i] = DROPPED;
+                    break;
+                }
+            }
+        }
+    }
+    slots = malloc(sizeof(uint64_t) * (max + 1));
+    for (n = max; ok && 0 < n; n--) {
+        for (b = 0; b < buckets; b++) {
+            if (n == starts[b + 1] - starts[b] && !dict_place(d, src, idx + starts[b], n, b, slots)) {
+                ok = false;
+                break;
+            }
+        }
+    }
+    free(slots);
+    free(idx);
+    free(starts);
+    if (!ok) {
+        dict_free(d);
+        return NULL;
+    }
+    return d;
+}
+
+// Number of epochs an entry is kept without being used.
+static uint32_t max_age(Cache c) {
+    switch (c->xrate) {
+    case 0: return UINT32_MAX;
+    case 1: return 4;
+    case 2: return 2;
+    default: return 1;
+    }
+}
+
+// Called when the table is full. Entries that are still in use are copied
+// into a new table which is twice the size if they fill half the table. The
+// new table is then published so a reader sees either the old table or the
+// complete new one. The old table of a locking cache is retired instead of
+// freed since a reader might still have it. Retired tables are freed in
+// cache_mark() since the GC never runs while a reader is in the middle of a
+// lookup.
+static void rehash(Cache c) {
+    Table    old  = c->table;
+    uint32_t age  = max_age(c);
+    uint64_t size = old->size;
+    uint64_t cnt  = 0;
+    uint64_t i;
+    Table    t;
+
+    for (i = 0; i < old->size; i++) {
+        if (0 == (0x80 & old->ctrl[i]) && c->epoch - old->entries[i].epoch <= age) {
+            cnt++;
+        }
+    }
+    if (size / 2 <= cnt) {
+        size *= 2;
+    }
+    t = table_new(size);
+    for (i = 0; i < old->size; i++) {
+        Entry e = old->entries + i;
+
+        if (0 == (0x80 & old->ctrl[i]) && c->epoch - e->epoch <= age) {
+            put(t, e->hash, e->key, e->klen, e->val, e->epoch);
+        }
+    }
+    STORE_RELEASE(&c->table, t);
+    c->rehashes++;
+    c->expunged += old->cnt - cnt;
+    if (c->locking) {
+        old->next  = c->retired;
+        c->retired = old;
     } else {
-        c->reuse = b->next;
-        c->rcnt--;
-    }
-    b->hash = h;
-    memcpy(b->key, key, len);
-    b->klen     = (uint8_t)len;
-    b->key[len] = '\0';
-    b->val      = rkey;
-    b->use_cnt  = 4;
-    b->next     = *bucket;
-    *bucket     = b;
-    c->cnt++;  // Don't worry about wrapping. Worse case is the entry is removed and recreated.
-    if (REHASH_LIMIT < c->cnt / c->size) {
+        table_free(old);
+    }
+}
+
+// Must be called with the lock held on a locking cache.
+static void insert(Cache c, uint64_t h, const char *key, size_t len, VALUE rkey) {
+    put(c->table, h, key, len, rkey, c->epoch);
+    if (c->table->size / 8 * 7 < c->table->cnt) {
         rehash(c);
     }
+}
+
+// Only set the epoch when it changes so a hit does not write to shared
+// memory.
+inline static VALUE hit(Cache c, Entry e) {
+    uint32_t epoch = c->epoch;
+
+    if (epoch != e->epoch) {
+        e->epoch = epoch;
+    }
+    return e->val;
+}
+
+static VALUE lockless_intern(Cache c, const char *key, size_t len) {
+    uint64_t       h = hash_calc((const uint8_t *)key, len);
+    Entry          e;
+    volatile VALUE rkey;
+
+    if (NULL != c->dict && NULL != (e = dict_find(c->dict, h, key, len))) {
+        c->hits++;
+        return e->val;
+    }
+    if (NULL != (e = find(c->table, h, key, len))) {
+        c->hits++;
+        return hit(c, e);
+    }
+    c->misses++;
+    rkey = c->form(key, len);
+    insert(c, h, key, len, rkey);
+
     return rkey;
 }
 
+// Lookups do not lock. Only a miss takes the lock to add the new entry.
 static VALUE locking_intern(Cache c, const char *key, size_t len) {
-    uint64_t       h;
-    Slot *         bucket;
-    Slot           b;
-    uint64_t       old_size;
+    uint64_t       h = hash_calc((const uint8_t *)key, len);
+    Dict           d = LOAD_ACQUIRE(&c->dict);
+    Entry          e;
     volatile VALUE rkey;
 
-    CACHE_LOCK(c);
-    while (REUSE_MAX < c->rcnt) {
-        if (NULL != (b = c->reuse)) {
-            c->reuse = b->next;
-            free(b);
-            c->rcnt--;
-        } else {
-            // An accounting error occured somewhere so correct it.
-            c->rcnt = 0;
-        }
+    if (NULL != d && NULL != (e = dict_find(d, h, key, len))) {
+        ADD_RELAXED(&c->hits);
+        return e->val;
     }
-    h      = hash_calc((const uint8_t *)key, len);
-    bucket = (Slot *)c->slots + (h & c->mask);
-    for (b = *bucket; NULL != b; b = b->next) {
-        if ((uint8_t)len == b->klen && 0 == strncmp(b->key, key, len)) {
-            b->use_cnt += 4;
-            CACHE_UNLOCK(c);
-
-            return b->val;
-        }
+    if (NULL != (e = find(LOAD_ACQUIRE(&c->table), h, key, len))) {
+        ADD_RELAXED(&c->hits);
+        return hit(c, e);
     }
-    old_size = c->size;
+    ADD_RELAXED(&c->misses);
     // The creation of a new value may trigger a GC which be a problem if the
     // cache is locked so make sure it is unlocked for the key value creation.
-    if (NULL != (b = c->reuse)) {
-        c->reuse = b->next;
-        c->rcnt--;
-    }
-    CACHE_UNLOCK(c);
-    if (NULL == b) {
-        b = calloc(1, sizeof(struct _slot));
-    }
-    rkey    = c->form(key, len);
-    b->hash = h;
-    memcpy(b->key, key, len);
-    b->klen     = (uint8_t)len;
-    b->key[len] = '\0';
-    b->val      = rkey;
-    b->use_cnt  = 16;
-
-    // Lock again to add the new entry.
+    rkey = c->form(key, len);
+
     CACHE_LOCK(c);
-    if (old_size != c->size) {
-        h      = hash_calc((const uint8_t *)key, len);
-        bucket = (Slot *)c->slots + (h & c->mask);
-    }
-    b->next = *bucket;
-    *bucket = b;
-    c->cnt++;  // Don't worry about wrapping. Worse case is the entry is removed and recreated.
-    if (REHASH_LIMIT < c->cnt / c->size) {
-        rehash(c);
+    // Another thread may have added the same key while the value was formed.
+    if (NULL != (e = find(c->table, h, key, len))) {
+        rkey = hit(c, e);
+    } else {
+        insert(c, h, key, len, rkey);
     }
     CACHE_UNLOCK(c);
 
@@ -228,25 +586,23 @@ static VALUE locking_intern(Cache c, const char *key, size_t len) {
 }
 
 Cache cache_create(size_t size, VALUE (*form)(const char *str, size_t len), bool mark, bool locking) {
-    Cache c     = calloc(1, sizeof(struct _cache));
-    int   shift = 0;
+    Cache    c     = calloc(1, sizeof(struct _cache));
+    uint64_t tsize = MIN_SIZE;
 
-    for (; REHASH_LIMIT < size; size /= 2, shift++) {
-    }
-    if (shift < MIN_SHIFT) {
-        shift = MIN_SHIFT;
+    // Room for size entries without going over the load limit.
+    while (tsize / 8 * 7 < size) {
+        tsize *= 2;
     }
 #if HAVE_PTHREAD_MUTEX_INIT
     pthread_mutex_init(&c->mutex, NULL);
 #else
     c->mutex = rb_mutex_new();
 #endif
-    c->size    = 1 << shift;
-    c->mask    = c->size - 1;
-    c->slots   = calloc(c->size, sizeof(Slot));
+    c->table   = table_new(tsize);
     c->form    = form;
     c->xrate   = 1;  // low
     c->mark    = mark;
+    c->locking = locking;
     if (locking) {
         c->intern = locking_intern;
     } else {
@@ -259,67 +615,309 @@ void cache_set_expunge_rate(Cache c, int rate) {
     c->xrate = (uint8_t)rate;
 }
 
-void cache_free(Cache c) {
-    uint64_t i;
+static void free_retired(Cache c) {
+    Table t;
+    Dict  d;
 
-    for (i = 0; i < c->size; i++) {
-        Slot next;
-        Slot s;
+    while (NULL != (t = c->retired)) {
+        c->retired = t->next;
+        table_free(t);
+    }
+    while (NULL != (d = c->retired_dicts)) {
+        c->retired_dicts = d->next;
+        dict_free(d);
+    }
+}
 
-        for (s = c->slots[i]; NULL != s; s = next) {
-            next = s->next;
-            free(s);
-        }
+void cache_free(Cache c) {
+    free_retired(c);
+    table_free(c->table);
+    if (NULL != c->dict) {
+        dict_free(c->dict);
     }
-    free((void *)c->slots);
     free(c);
 }
 
+// Starts a new epoch and marks the values. No entries are expunged here.
 void cache_mark(Cache c) {
+    Table    t = c->table;
     uint64_t i;
 
 #if !HAVE_PTHREAD_MUTEX_INIT
     rb_gc_mark(c->mutex);
 #endif
-    if (0 == c->cnt) {
+    c->epoch++;
+    free_retired(c);
+    if (!c->mark) {
         return;
     }
-    for (i = 0; i < c->size; i++) {
-        Slot s;
-        Slot prev = NULL;
-        Slot next;
-
-        for (s = c->slots[i]; NULL != s; s = next) {
-            next = s->next;
-            if (0 == s->use_cnt) {
-                if (NULL == prev) {
-                    c->slots[i] = next;
-                } else {
-                    prev->next = next;
-                }
-                c->cnt--;
-                s->next  = c->reuse;
-                c->reuse = s;
-                c->rcnt++;
-                continue;
+    if (NULL != c->dict) {
+        for (i = 0; i < c->dict->size; i++) {
+            if (NULL != c->dict->entries[i].key) {
+                mark_value(c->dict->entries[i].val);
+            }
+        }
+    }
+    for (i = 0; 0 < t->cnt && i < t->size; i += GROUP) {
+        uint32_t m;
+
+        for (m = group_full(t->ctrl + i); 0 != m; m &= m - 1) {
+            mark_value(t->entries[i + CTZ(m)].val);
+        }
+    }
+}
+
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+// Updates the values moved by GC.compact. Retired tables were freed in the
+// mark that preceded the compaction so only the current table and
+// dictionary are updated.
+void cache_compact(Cache c) {
+    Table    t = c->table;
+    uint64_t i;
+
+    if (!c->mark) {
+        return;
+    }
+    if (NULL != c->dict) {
+        for (i = 0; i < c->dict->size; i++) {
+            Entry e = c->dict->entries + i;
+
+            if (NULL != e->key) {
+                e->val = rb_gc_location(e->val);
+            }
+        }
+    }
+    for (i = 0; 0 < t->cnt && i < t->size; i += GROUP) {
+        uint32_t m;
+
+        for (m = group_full(t->ctrl + i); 0 != m; m &= m - 1) {
+            Entry e = t->entries + i + CTZ(m);
+
+            e->val = rb_gc_location(e->val);
+        }
+    }
+}
+#endif
+
+static size_t table_bytes(Table t) {
+    size_t bytes = sizeof(struct _table) + t->size + t->size * sizeof(struct _entry);
+    Block  b;
+
+    for (b = t->keys; NULL != b; b = b->next) {
+        bytes += sizeof(struct _block) + b->cap;
+    }
+    return bytes;
+}
+
+static size_t dict_bytes(Dict d) {
+    size_t bytes = sizeof(struct _dict) + d->size * sizeof(struct _entry) + (d->bmask + 1) * sizeof(uint32_t);
+    Block  b;
+
+    for (b = d->keys; NULL != b; b = b->next) {
+        bytes += sizeof(struct _block) + b->cap;
+    }
+    return bytes;
+}
+
+// Returns a Hash of the cache counters and sizes. The numbers are gathered
+// under the lock of a locking cache and the Hash is built after the lock is
+// released since building it might trigger a GC.
+VALUE
+cache_stats(Cache c) {
+    VALUE    h = Qnil;
+    Table    t;
+    uint64_t size;
+    uint64_t cnt;
+    uint64_t retired   = 0;
+    uint64_t permanent = 0;
+    size_t   bytes     = sizeof(struct _cache);
+    Dict     d;
+
+    if (c->locking) {
+        CACHE_LOCK(c);
+    }
+    t    = c->table;
+    size = t->size;
+    cnt  = t->cnt;
+    bytes += table_bytes(t);
+    for (t = c->retired; NULL != t; t = t->next) {
+        retired++;
+        bytes += table_bytes(t);
+    }
+    if (NULL != (d = c->dict)) {
+        permanent = d->cnt;
+        bytes += dict_bytes(d);
+    }
+    for (d = c->retired_dicts; NULL != d; d = d->next) {
+        bytes += dict_bytes(d);
+    }
+    if (c->locking) {
+        CACHE_UNLOCK(c);
+    }
+    h = rb_hash_new();
+    rb_hash_aset(h, ID2SYM(rb_intern("size")), ULL2NUM(size));
+    rb_hash_aset(h, ID2SYM(rb_intern("count")), ULL2NUM(cnt));
+    rb_hash_aset(h, ID2SYM(rb_intern("hits")), ULL2NUM(c->hits));
+    rb_hash_aset(h, ID2SYM(rb_intern("misses")), ULL2NUM(c->misses));
+    rb_hash_aset(h, ID2SYM(rb_intern("rehashes")), ULL2NUM(c->rehashes));
+    rb_hash_aset(h, ID2SYM(rb_intern("expunged")), ULL2NUM(c->expunged));
+    rb_hash_aset(h, ID2SYM(rb_intern("retired")), ULL2NUM(retired));
+    rb_hash_aset(h, ID2SYM(rb_intern("permanent")), ULL2NUM(permanent));
+    rb_hash_aset(h, ID2SYM(rb_intern("bytes")), SIZET2NUM(bytes));
+
+    return h;
+}
+
+// Returns the value already cached for a key or a new one. The table is not
+// changed and the counters are left alone.
+static VALUE registered_value(Cache c, const char *key, size_t len) {
+    uint64_t h = hash_calc((const uint8_t *)key, len);
+    Dict     d = LOAD_ACQUIRE(&c->dict);
+    Entry    e;
+
+    if (NULL != d && NULL != (e = dict_find(d, h, key, len))) {
+        return e->val;
+    }
+    if (NULL != (e = find(LOAD_ACQUIRE(&c->table), h, key, len))) {
+        return e->val;
+    }
+    return c->form(key, len);
+}
+
+// Adds the keys, an Array of Strings or Symbols, to the dictionary of the
+// cache. The values are formed first, outside the lock, and kept in an
+// Array so a GC while forming does not free them. A new dictionary with the
+// old and new keys is then built and replaces the old one.
+void cache_register(Cache c, VALUE keys) {
+    volatile VALUE strs;
+    volatile VALUE vals;
+    Entry          src;
+    Dict           old;
+    Dict           d;
+    uint64_t       cnt = 0;
+    uint64_t       size;
+    uint64_t       i;
+    long           n;
+    long           k;
+
+    Check_Type(keys, T_ARRAY);
+    n    = RARRAY_LEN(keys);
+    strs = rb_ary_new_capa(n);
+    vals = rb_ary_new_capa(n);
+    for (k = 0; k < n; k++) {
+        VALUE key = RARRAY_AREF(keys, k);
+
+        if (T_SYMBOL == rb_type(key)) {
+            key = rb_sym2str(key);
+        }
+        Check_Type(key, T_STRING);
+        if (CACHE_MAX_LEN < RSTRING_LEN(key)) {
+            rb_raise(rb_eArgError, "keys longer than %d bytes can not be registered", CACHE_MAX_LEN);
+        }
+        rb_ary_push(strs, key);
+        rb_ary_push(vals, registered_value(c, RSTRING_PTR(key), RSTRING_LEN(key)));
+    }
+    if (0 == n) {
+        return;
+    }
+    if (c->locking) {
+        CACHE_LOCK(c);
+    }
+    old = c->dict;
+    src = malloc(sizeof(struct _entry) * (n + (NULL == old ? 0 : old->cnt)));
+    if (NULL != old) {
+        for (i = 0; i < old->size; i++) {
+            if (NULL != old->entries[i].key) {
+                src[cnt++] = old->entries[i];
             }
-            switch (c->xrate) {
-            case 0: break;
-            case 2: s->use_cnt -= 2; break;
-            case 3: s->use_cnt /= 2; break;
-            default: s->use_cnt--; break;
+        }
+    }
+    for (k = 0; k < n; k++) {
+        VALUE key = RARRAY_AREF(strs, k);
+        Entry e   = src + cnt++;
+
+        e->val   = RARRAY_AREF(vals, k);
+        e->key   = RSTRING_PTR(key);
+        e->klen  = (uint32_t)RSTRING_LEN(key);
+        e->hash  = hash_calc((const uint8_t *)e->key, e->klen);
+        e->epoch = 0;
+    }
+    size = MIN_DICT_SIZE;
+    while (size < cnt * 2) {
+        size *= 2;
+    }
+    while (NULL == (d = dict_new(src, cnt, size))) {
+        size *= 2;
+    }
+    free(src);
+    STORE_RELEASE(&c->dict, d);
+    if (NULL != old) {
+        if (c->locking) {
+            old->next        = c->retired_dicts;
+            c->retired_dicts = old;
+        } else {
+            dict_free(old);
+        }
+    }
+    if (c->locking) {
+        CACHE_UNLOCK(c);
+    }
+    RB_GC_GUARD(strs);
+    RB_GC_GUARD(vals);
+}
+
+// Returns the registered keys as an Array of Strings. The keys are copied
+// under the lock and the Strings made after it is released.
+VALUE
+cache_registered(Cache c) {
+    VALUE     a;
+    Dict      d;
+    char *    buf  = NULL;
+    uint32_t *lens = NULL;
+    uint64_t  cnt  = 0;
+    uint64_t  i;
+    size_t    len = 0;
+
+    if (c->locking) {
+        CACHE_LOCK(c);
+    }
+    if (NULL != (d = c->dict)) {
+        for (i = 0; i < d->size; i++) {
+            if (NULL != d->entries[i].key) {
+                len += d->entries[i].klen;
             }
-            if (c->mark) {
-                rb_gc_mark(s->val);
+        }
+        buf  = malloc(len + 1);
+        lens = malloc(sizeof(uint32_t) * (d->cnt + 1));
+        len  = 0;
+        for (i = 0; i < d->size; i++) {
+            Entry e = d->entries + i;
+
+            if (NULL != e->key) {
+                memcpy(buf + len, e->key, e->klen);
+                len += e->klen;
+                lens[cnt++] = e->klen;
             }
-            prev = s;
         }
     }
+    if (c->locking) {
+        CACHE_UNLOCK(c);
+    }
+    a   = rb_ary_new_capa((long)cnt);
+    len = 0;
+    for (i = 0; i < cnt; i++) {
+        rb_ary_push(a, rb_utf8_str_new(buf + len, lens[i]));
+        len += lens[i];
+    }
+    free(buf);
+    free(lens);
+
+    return a;
 }
 
 VALUE
 cache_intern(Cache c, const char *key, size_t len) {
-    if (CACHE_MAX_KEY <= len) {
+    if (CACHE_MAX_LEN < len) {
         return c->form(key, len);
     }
     return c->intern(c, key, len);
@@ -14,8 +14,14 @@ struct _cache;
 extern struct _cache *cache_create(size_t size, VALUE (*form)(const char *str, size_t len), bool mark, bool locking);
 extern void           cache_free(struct _cache *c);
 extern void           cache_mark(struct _cache *c);
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+extern void           cache_compact(struct _cache *c);
+#endif
 extern void           cache_set_form(struct _cache *c, VALUE (*form)(const char *str, size_t len));
 extern VALUE          cache_intern(struct _cache *c, const char *key, size_t len);
 extern void           cache_set_expunge_rate(struct _cache *c, int rate);
+extern VALUE          cache_stats(struct _cache *c);
+extern void           cache_register(struct _cache *c, VALUE keys);
+extern VALUE          cache_registered(struct _cache *c);
 
 #endif /* CACHE_H */
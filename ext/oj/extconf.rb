@@ -28,7 +28,9 @@ have_func('rb_gc_mark_movable')
 have_func('stpcpy')
 have_func('pthread_mutex_init')
 have_func('rb_enc_interned_str')
+have_func('rb_hash_new_capa', 'ruby.h')
 have_func('rb_ext_ractor_safe', 'ruby.h')
+have_func('rb_io_buffer_get_bytes_for_reading', 'ruby/io/buffer.h')
 # rb_hash_bulk_insert is deep down in a header not included in normal build and that seems to fool have_func.
 have_func('rb_hash_bulk_insert', 'ruby.h') unless '2' == version[0] && '6' == version[1]
 
@@ -39,6 +41,10 @@ if with_config('--with-sse42')
   dflags['OJ_USE_SSE4_2'] = 1
 end
 
+# The Oj::Parser picks the widest SIMD instructions the CPU supports at run
+# time. Use --without-simd to build with just the byte map scanners.
+dflags['OJ_NO_SIMD'] = 1 unless with_config('simd', true)
+
 dflags.each do |k,v|
   if v.nil?
     $CPPFLAGS += " -D#{k}"
@@ -27,6 +27,8 @@ typedef struct _keyVal {
 
 typedef struct _hash {
     struct _keyVal slots[HASH_SLOT_CNT];
+    uint64_t       hits;
+    uint64_t       misses;
 #if HAVE_PTHREAD_MUTEX_INIT
     pthread_mutex_t mutex;
 #else
@@ -43,6 +45,80 @@ static VALUE          sym_cache_obj;
 
 static VALUE          attr_cache_obj;
 
+static VALUE          class_hash_obj;
+
+static void cache_mark_cb(void *ptr) {
+    cache_mark((struct _cache *)ptr);
+}
+
+static void cache_free_cb(void *ptr) {
+    cache_free((struct _cache *)ptr);
+}
+
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+static void cache_compact_cb(void *ptr) {
+    cache_compact((struct _cache *)ptr);
+}
+#endif
+
+static const rb_data_type_t oj_cache_type = {
+    "Oj/cache",
+    {
+        cache_mark_cb,
+        cache_free_cb,
+        NULL,
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+        cache_compact_cb,
+#endif
+    },
+    0,
+    0,
+};
+
+// The class hash is a static struct. It is marked through an object
+// registered with the GC so the classes it holds are not pinned.
+static void class_hash_mark(void *ptr) {
+    KeyVal b;
+    int    i;
+
+    for (i = 0; i < (int)HASH_SLOT_CNT; i++) {
+        for (b = class_hash.slots + i; NULL != b; b = b->next) {
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+            rb_gc_mark_movable(b->val);
+#else
+            rb_gc_mark(b->val);
+#endif
+        }
+    }
+}
+
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+static void class_hash_compact(void *ptr) {
+    KeyVal b;
+    int    i;
+
+    for (i = 0; i < (int)HASH_SLOT_CNT; i++) {
+        for (b = class_hash.slots + i; NULL != b; b = b->next) {
+            b->val = rb_gc_location(b->val);
+        }
+    }
+}
+#endif
+
+static const rb_data_type_t oj_class_hash_type = {
+    "Oj/class_hash",
+    {
+        class_hash_mark,
+        NULL,
+        NULL,
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+        class_hash_compact,
+#endif
+    },
+    0,
+    0,
+};
+
 static VALUE form_str(const char *str, size_t len) {
     return rb_str_freeze(rb_utf8_str_new(str, len));
 }
@@ -91,18 +167,20 @@ void oj_hash_init(void) {
     rb_undef_alloc_func(cache_class);
 
     struct _cache *str_cache     = cache_create(0, form_str, true, true);
-    str_cache_obj = Data_Wrap_Struct(cache_class, cache_mark, cache_free, str_cache);
+    str_cache_obj = TypedData_Wrap_Struct(cache_class, &oj_cache_type, str_cache);
     rb_gc_register_address(&str_cache_obj);
 
     struct _cache *sym_cache     = cache_create(0, form_sym, true, true);
-    sym_cache_obj = Data_Wrap_Struct(cache_class, cache_mark, cache_free, sym_cache);
+    sym_cache_obj = TypedData_Wrap_Struct(cache_class, &oj_cache_type, sym_cache);
     rb_gc_register_address(&sym_cache_obj);
 
     struct _cache *attr_cache = cache_create(0, form_attr, false, true);
-    attr_cache_obj = Data_Wrap_Struct(cache_class, cache_mark, cache_free, attr_cache);
+    attr_cache_obj = TypedData_Wrap_Struct(cache_class, &oj_cache_type, attr_cache);
     rb_gc_register_address(&attr_cache_obj);
 
     memset(class_hash.slots, 0, sizeof(class_hash.slots));
+    class_hash_obj = TypedData_Wrap_Struct(cache_class, &oj_class_hash_type, &class_hash);
+    rb_gc_register_address(&class_hash_obj);
 #if HAVE_PTHREAD_MUTEX_INIT
     pthread_mutex_init(&class_hash.mutex, NULL);
 #else
@@ -237,6 +315,7 @@ VALUE oj_class_intern(const char *key, size_t len, bool safe, ParseInfo pi, int
         if (NULL != bucket->key) {  // not the top slot
             for (b = bucket; 0 != b; b = b->next) {
                 if (len == b->len && 0 == strncmp(b->key, key, len)) {
+                    class_hash.hits++;
 #if HAVE_PTHREAD_MUTEX_INIT
                     pthread_mutex_unlock(&class_hash.mutex);
 #else
@@ -248,9 +327,12 @@ VALUE oj_class_intern(const char *key, size_t len, bool safe, ParseInfo pi, int
             }
             b            = ALLOC(struct _keyVal);
             b->next      = NULL;
+            b->key       = NULL;
+            b->val       = Qnil;  // marked before the class is resolved
             bucket->next = b;
             bucket       = b;
         }
+        class_hash.misses++;
         bucket->key = oj_strndup(key, len);
         bucket->len = len;
         bucket->val = resolve_classpath(pi, key, len, auto_define, error_class);
@@ -263,23 +345,78 @@ VALUE oj_class_intern(const char *key, size_t len, bool safe, ParseInfo pi, int
         if (NULL != bucket->key) {
             for (b = bucket; 0 != b; b = b->next) {
                 if (len == b->len && 0 == strncmp(b->key, key, len)) {
+                    class_hash.hits++;
                     return (ID)b->val;
                 }
                 bucket = b;
             }
             b            = ALLOC(struct _keyVal);
             b->next      = NULL;
+            b->key       = NULL;
+            b->val       = Qnil;  // marked before the class is resolved
             bucket->next = b;
             bucket       = b;
         }
+        class_hash.misses++;
         bucket->key = oj_strndup(key, len);
         bucket->len = len;
         bucket->val = resolve_classpath(pi, key, len, auto_define, error_class);
     }
-    rb_gc_register_mark_object(bucket->val);
     return bucket->val;
 }
 
+static VALUE class_hash_stats(void) {
+    VALUE  h     = rb_hash_new();
+    size_t cnt   = 0;
+    size_t bytes = sizeof(class_hash);
+    KeyVal b;
+    int    i;
+
+    for (i = 0; i < (int)HASH_SLOT_CNT; i++) {
+        for (b = class_hash.slots + i; NULL != b; b = b->next) {
+            if (NULL != b->key) {
+                cnt++;
+                bytes += b->len + 1;
+            }
+            if (b != class_hash.slots + i) {
+                bytes += sizeof(struct _keyVal);
+            }
+        }
+    }
+    rb_hash_aset(h, ID2SYM(rb_intern("size")), ULL2NUM(HASH_SLOT_CNT));
+    rb_hash_aset(h, ID2SYM(rb_intern("count")), SIZET2NUM(cnt));
+    rb_hash_aset(h, ID2SYM(rb_intern("hits")), ULL2NUM(class_hash.hits));
+    rb_hash_aset(h, ID2SYM(rb_intern("misses")), ULL2NUM(class_hash.misses));
+    rb_hash_aset(h, ID2SYM(rb_intern("rehashes")), INT2FIX(0));
+    rb_hash_aset(h, ID2SYM(rb_intern("expunged")), INT2FIX(0));
+    rb_hash_aset(h, ID2SYM(rb_intern("retired")), INT2FIX(0));
+    rb_hash_aset(h, ID2SYM(rb_intern("permanent")), INT2FIX(0));
+    rb_hash_aset(h, ID2SYM(rb_intern("bytes")), SIZET2NUM(bytes));
+
+    return h;
+}
+
+VALUE
+oj_cache_stats(void) {
+    VALUE h = rb_hash_new();
+
+    rb_hash_aset(h, ID2SYM(rb_intern("str")), cache_stats(DATA_PTR(str_cache_obj)));
+    rb_hash_aset(h, ID2SYM(rb_intern("sym")), cache_stats(DATA_PTR(sym_cache_obj)));
+    rb_hash_aset(h, ID2SYM(rb_intern("attr")), cache_stats(DATA_PTR(attr_cache_obj)));
+    rb_hash_aset(h, ID2SYM(rb_intern("class")), class_hash_stats());
+
+    return h;
+}
+
+void oj_register_keys(VALUE keys, bool symbols) {
+    cache_register(DATA_PTR(symbols ? sym_cache_obj : str_cache_obj), keys);
+}
+
+VALUE
+oj_registered_keys(bool symbols) {
+    return cache_registered(DATA_PTR(symbols ? sym_cache_obj : str_cache_obj));
+}
+
 char *oj_strndup(const char *s, size_t len) {
     char *d = ALLOC_N(char, len + 1);
 
@@ -20,6 +20,9 @@ extern VALUE oj_class_intern(const char *       key,
                              struct _parseInfo *pi,
                              int                auto_define,
                              VALUE              error_class);
+extern VALUE oj_cache_stats(void);
+extern void  oj_register_keys(VALUE keys, bool symbols);
+extern VALUE oj_registered_keys(bool symbols);
 
 extern char *oj_strndup(const char *s, size_t len);
 
@@ -0,0 +1,481 @@
+// Copyright (c) 2026 the Oj contributors. All rights reserved.
+// Licensed under the MIT License. See LICENSE file in the project root for license details.
+
+#include "oj.h"
+#include "tape.h"
+
+// The Lazy delegate records the document on a tape and returns an
+// Oj::Parser::Lazy that refers to the tape instead of building the Ruby
+// objects. Objects are only created for the values that are looked up. An
+// array or object value is returned as another Lazy that shares the same
+// tape. Since each open op on the tape has the index of its close op a
+// lookup steps over the members that are not wanted.
+
+typedef struct _doc {
+    ojOp   ops;
+    char  *strs;
+    size_t ops_cap;  // ops allocated
+    size_t strs_cap;
+} * Doc;
+
+typedef struct _lazy {
+    VALUE  root;  // the Lazy that owns the doc
+    Doc    doc;
+    size_t pos;  // index of the open op
+} * Lazy;
+
+typedef struct _delegate {
+    struct _ojTape tape;  // first so the ctx is also the tape
+    VALUE          result;
+} * Delegate;
+
+static VALUE lazy_class = Qundef;
+
+static ID dig_id;
+static ID to_a_id;
+
+static void lazy_mark(void *ptr) {
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+    rb_gc_mark_movable(((Lazy)ptr)->root);
+#else
+    rb_gc_mark(((Lazy)ptr)->root);
+#endif
+}
+
+static void lazy_free(void *ptr) {
+    Lazy l = (Lazy)ptr;
+
+    // Only the root is at the start of the tape.
+    if (0 == l->pos) {
+        free(l->doc->ops);
+        free(l->doc->strs);
+        xfree(l->doc);
+    }
+    xfree(l);
+}
+
+static size_t lazy_memsize(const void *ptr) {
+    Lazy   l    = (Lazy)ptr;
+    size_t size = sizeof(struct _lazy);
+
+    // The tape is counted once, on the root.
+    if (0 == l->pos) {
+        size += sizeof(struct _doc) + l->doc->ops_cap * sizeof(struct _ojOp) + l->doc->strs_cap;
+    }
+    return size;
+}
+
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+static void lazy_compact(void *ptr) {
+    Lazy l = (Lazy)ptr;
+
+    l->root = rb_gc_location(l->root);
+}
+#endif
+
+static const rb_data_type_t oj_lazy_type = {
+    "Oj/parser/lazy",
+    {
+        lazy_mark,
+        lazy_free,
+        lazy_memsize,
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+        lazy_compact,
+#endif
+    },
+    0,
+    0,
+};
+
+static VALUE lazy_new(VALUE root, Doc doc, ojOp op) {
+    Lazy  l = ALLOC(struct _lazy);
+    VALUE v;
+
+    l->root = root;
+    l->doc  = doc;
+    l->pos  = op - doc->ops;
+    v       = TypedData_Wrap_Struct(lazy_class, &oj_lazy_type, l);
+    if (Qnil == root) {
+        l->root = v;
+    }
+    return v;
+}
+
+// The op after a value, stepping over the members of an array or object.
+inline static ojOp next_op(Doc doc, ojOp op) {
+    if ('{' == op->type || '[' == op->type) {
+        return doc->ops + op->v.off + 1;
+    }
+    return op + 1;
+}
+
+static VALUE str_value(Doc doc, ojOp op) {
+    return oj_str_cr(rb_utf8_str_new(doc->strs + op->v.off, op->len), op->cr);
+}
+
+static VALUE leaf_value(Doc doc, ojOp op) {
+    switch (op->type) {
+    case 't': return Qtrue;
+    case 'f': return Qfalse;
+    case 'i': return LONG2NUM(op->v.fixnum);
+    case 'd': {
+        long double d;
+
+        memcpy(&d, doc->strs + op->v.off, sizeof(d));
+        return rb_float_new((double)d);
+    }
+    case 'b': return rb_funcall(rb_cObject, oj_bigdecimal_id, 1, rb_str_new(doc->strs + op->v.off, op->len));
+    case 's': return str_value(doc, op);
+    default: break;
+    }
+    return Qnil;
+}
+
+static VALUE op_value(VALUE root, Doc doc, ojOp op) {
+    if ('{' == op->type || '[' == op->type) {
+        return lazy_new(root, doc, op);
+    }
+    return leaf_value(doc, op);
+}
+
+// Builds all the Ruby objects for the value at op.
+static VALUE build(Doc doc, ojOp op) {
+    ojOp end;
+
+    switch (op->type) {
+    case '{': {
+        volatile VALUE h = rb_hash_new();
+
+        end = doc->ops + op->v.off;
+        for (op++; op < end; op = next_op(doc, op + 1)) {
+            rb_hash_aset(h, rb_str_freeze(str_value(doc, op)), build(doc, op + 1));
+        }
+        return h;
+    }
+    case '[': {
+        volatile VALUE a = rb_ary_new_capa(op->len);
+
+        end = doc->ops + op->v.off;
+        for (op++; op < end; op = next_op(doc, op)) {
+            rb_ary_push(a, build(doc, op));
+        }
+        return a;
+    }
+    default: break;
+    }
+    return leaf_value(doc, op);
+}
+
+// Returns the op of the member of the array or object at op or NULL if there
+// is no such member.
+static ojOp lookup(Doc doc, ojOp op, VALUE key) {
+    ojOp end = doc->ops + op->v.off;
+
+    if ('[' == op->type) {
+        long i = NUM2LONG(key);
+
+        if (i < 0) {
+            i += (long)op->len;
+        }
+        if (i < 0 || (long)op->len <= i) {
+            return NULL;
+        }
+        for (op++; 0 < i; i--) {
+            op = next_op(doc, op);
+        }
+        return op;
+    }
+    switch (rb_type(key)) {
+    case RUBY_T_SYMBOL: key = rb_sym2str(key); break;
+    case RUBY_T_STRING: break;
+    default: return NULL;
+    }
+    for (op++; op < end; op = next_op(doc, op + 1)) {
+        if ((long)op->len == RSTRING_LEN(key) && 0 == memcmp(doc->strs + op->v.off, RSTRING_PTR(key), op->len)) {
+            return op + 1;
+        }
+    }
+    return NULL;
+}
+
+/* Document-method: []
+ * call-seq: [](key)
+ *
+ * Returns the member of an object with the String or Symbol key or the
+ * element of an array at the index. Arrays and objects are returned as
+ * another Lazy and everything else is converted to a Ruby object. Returns
+ * nil if there is no such member.
+ */
+static VALUE lazy_get(VALUE self, VALUE key) {
+    Lazy l  = (Lazy)DATA_PTR(self);
+    ojOp op = lookup(l->doc, l->doc->ops + l->pos, key);
+
+    if (NULL == op) {
+        return Qnil;
+    }
+    return op_value(l->root, l->doc, op);
+}
+
+/* Document-method: dig
+ * call-seq: dig(key, *keys)
+ *
+ * Looks up each key in turn like Hash#dig. Only the last value is returned
+ * and no objects are created for the ones along the way.
+ */
+static VALUE lazy_dig(int argc, VALUE *argv, VALUE self) {
+    Lazy l  = (Lazy)DATA_PTR(self);
+    ojOp op = l->doc->ops + l->pos;
+    int  i;
+
+    rb_check_arity(argc, 1, UNLIMITED_ARGUMENTS);
+    for (i = 0; i < argc; i++) {
+        if ('{' != op->type && '[' != op->type) {
+            VALUE v = leaf_value(l->doc, op);
+
+            if (Qnil == v) {
+                return Qnil;
+            }
+            if (!rb_respond_to(v, dig_id)) {
+                rb_raise(rb_eTypeError, "%s does not have #dig method", rb_obj_classname(v));
+            }
+            return rb_funcallv(v, dig_id, argc - i, argv + i);
+        }
+        if (NULL == (op = lookup(l->doc, op, argv[i]))) {
+            return Qnil;
+        }
+    }
+    return op_value(l->root, l->doc, op);
+}
+
+/* Document-method: size
+ * call-seq: size
+ *
+ * Returns the number of members of the object or elements of the array.
+ */
+static VALUE lazy_size(VALUE self) {
+    Lazy l = (Lazy)DATA_PTR(self);
+
+    return ULONG2NUM(l->doc->ops[l->pos].len);
+}
+
+/* Document-method: array?
+ * call-seq: array?
+ *
+ * Returns true if the value is an array and false if an object.
+ */
+static VALUE lazy_array(VALUE self) {
+    Lazy l = (Lazy)DATA_PTR(self);
+
+    return ('[' == l->doc->ops[l->pos].type) ? Qtrue : Qfalse;
+}
+
+/* Document-method: keys
+ * call-seq: keys
+ *
+ * Returns the keys of an object or an empty Array for an array.
+ */
+static VALUE lazy_keys(VALUE self) {
+    Lazy           l    = (Lazy)DATA_PTR(self);
+    Doc            doc  = l->doc;
+    ojOp           op   = doc->ops + l->pos;
+    ojOp           end  = doc->ops + op->v.off;
+    volatile VALUE keys = rb_ary_new();
+
+    if ('{' == op->type) {
+        for (op++; op < end; op = next_op(doc, op + 1)) {
+            rb_ary_push(keys, str_value(doc, op));
+        }
+    }
+    return keys;
+}
+
+/* Document-method: key?
+ * call-seq: key?(key)
+ *
+ * Returns true if the object has a member with the key.
+ */
+static VALUE lazy_has_key(VALUE self, VALUE key) {
+    Lazy l  = (Lazy)DATA_PTR(self);
+    ojOp op = l->doc->ops + l->pos;
+
+    if ('{' != op->type) {
+        return Qfalse;
+    }
+    return (NULL == lookup(l->doc, op, key)) ? Qfalse : Qtrue;
+}
+
+/* Document-method: each
+ * call-seq: each { |value| } or each { |key, value| }
+ *
+ * Yields each element of an array or each key and value of an object. Arrays
+ * and objects are yielded as another Lazy.
+ */
+static VALUE lazy_each(VALUE self) {
+    Lazy l   = (Lazy)DATA_PTR(self);
+    Doc  doc = l->doc;
+    ojOp op  = doc->ops + l->pos;
+    ojOp end = doc->ops + op->v.off;
+
+    RETURN_ENUMERATOR(self, 0, 0);
+    if ('{' == op->type) {
+        for (op++; op < end; op = next_op(doc, op + 1)) {
+            rb_yield_values(2, str_value(doc, op), op_value(l->root, doc, op + 1));
+        }
+    } else {
+        for (op++; op < end; op = next_op(doc, op)) {
+            rb_yield(op_value(l->root, doc, op));
+        }
+    }
+    return self;
+}
+
+/* Document-method: to_ruby
+ * call-seq: to_ruby
+ *
+ * Returns the Hash or Array with all the members built as Ruby objects.
+ */
+static VALUE lazy_to_ruby(VALUE self) {
+    Lazy l = (Lazy)DATA_PTR(self);
+
+    return build(l->doc, l->doc->ops + l->pos);
+}
+
+/* Document-method: to_h
+ * call-seq: to_h
+ *
+ * Returns the object as a Hash with all the members built as Ruby objects.
+ */
+static VALUE lazy_to_h(VALUE self) {
+    Lazy l = (Lazy)DATA_PTR(self);
+
+    if ('{' != l->doc->ops[l->pos].type) {
+        rb_raise(rb_eTypeError, "an array can not be converted to a Hash");
+    }
+    return build(l->doc, l->doc->ops + l->pos);
+}
+
+/* Document-method: to_a
+ * call-seq: to_a
+ *
+ * Returns the array as an Array with all the elements built as Ruby objects
+ * or the members of an object as key and value pairs.
+ */
+static VALUE lazy_to_a(VALUE self) {
+    Lazy  l = (Lazy)DATA_PTR(self);
+    VALUE v = build(l->doc, l->doc->ops + l->pos);
+
+    if (T_HASH == rb_type(v)) {
+        return rb_funcall(v, to_a_id, 0);
+    }
+    return v;
+}
+
+/* Document-method: inspect
+ * call-seq: inspect
+ *
+ * Returns the inspect String of the fully built value.
+ */
+static VALUE lazy_inspect(VALUE self) {
+    return rb_inspect(lazy_to_ruby(self));
+}
+
+static VALUE option(ojParser p, const char *key, VALUE value) {
+    rb_raise(rb_eArgError, "%s is not an option for the Lazy delegate", key);
+    return Qnil;
+}
+
+// The tape of a completed document is handed off to the Lazy that is
+// returned so the next document starts a new tape.
+static VALUE result(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+    ojTape   t = &d->tape;
+    Doc      doc;
+
+    if (Qundef != d->result) {
+        return d->result;
+    }
+    if (t->tail == t->head) {
+        return Qnil;
+    }
+    if ('{' != t->head->type && '[' != t->head->type) {
+        struct _doc leaf = {t->head, t->strs, 0, 0};
+
+        d->result = leaf_value(&leaf, t->head);
+        return d->result;
+    }
+    doc           = ALLOC(struct _doc);
+    doc->ops      = t->head;
+    doc->strs     = t->strs;
+    doc->ops_cap  = t->end - t->head;
+    doc->strs_cap = t->strs_cap;
+    t->head   = NULL;
+    t->tail   = NULL;
+    t->end    = NULL;
+    t->strs   = NULL;
+
+    t->strs_len = 0;
+    t->strs_cap = 0;
+    d->result   = lazy_new(Qnil, doc, doc->ops);
+
+    return d->result;
+}
+
+static void start(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+
+    d->tape.tail     = d->tape.head;
+    d->tape.strs_len = 0;
+    d->result        = Qundef;
+}
+
+static void dfree(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+
+    oj_tape_cleanup(&d->tape);
+    xfree(d);
+}
+
+static void mark(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+
+    if (NULL != d && Qundef != d->result) {
+        rb_gc_mark(d->result);
+    }
+}
+
+void oj_set_parser_lazy(ojParser p) {
+    Delegate d = ALLOC(struct _delegate);
+
+    oj_tape_init(&d->tape);
+    d->result = Qundef;
+
+    p->ctx = (void *)d;
+    oj_tape_set_funcs(p);
+    p->option = option;
+    p->result = result;
+    p->free   = dfree;
+    p->mark   = mark;
+    p->start  = start;
+}
+
+void oj_lazy_init(VALUE parser_class) {
+    lazy_class = rb_define_class_under(parser_class, "Lazy", rb_cObject);
+    rb_gc_register_address(&lazy_class);
+    rb_undef_alloc_func(lazy_class);
+
+    dig_id  = rb_intern("dig");
+    to_a_id = rb_intern("to_a");
+
+    rb_define_method(lazy_class, "[]", lazy_get, 1);
+    rb_define_method(lazy_class, "dig", lazy_dig, -1);
+    rb_define_method(lazy_class, "size", lazy_size, 0);
+    rb_define_method(lazy_class, "length", lazy_size, 0);
+    rb_define_method(lazy_class, "array?", lazy_array, 0);
+    rb_define_method(lazy_class, "keys", lazy_keys, 0);
+    rb_define_method(lazy_class, "key?", lazy_has_key, 1);
+    rb_define_method(lazy_class, "each", lazy_each, 0);
+    rb_define_method(lazy_class, "to_ruby", lazy_to_ruby, 0);
+    rb_define_method(lazy_class, "to_h", lazy_to_h, 0);
+    rb_define_method(lazy_class, "to_a", lazy_to_a, 0);
+    rb_define_method(lazy_class, "inspect", lazy_inspect, 0);
+}
@@ -0,0 +1,14 @@
+// Copyright (c) 2026 the Oj contributors. All rights reserved.
+// Licensed under the MIT License. See LICENSE file in the project root for license details.
+
+#ifndef OJ_LEMIRE_H
+#define OJ_LEMIRE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Converts mantissa * 10^exp10 to the nearest double. Returns false if the
+// result can not be determined quickly and a slower method must be used.
+extern bool oj_lemire_double(uint64_t mantissa, int64_t exp10, bool neg, double *dp);
+
+#endif /* OJ_LEMIRE_H */
@@ -0,0 +1,334 @@
+// Copyright (c) 2026 the Oj contributors. All rights reserved.
+// Licensed under the MIT License. See LICENSE file in the project root for license details.
+
+#include "tape.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if !IS_WINDOWS
+#include <sys/mman.h>
+#endif
+#if HAVE_PTHREAD_MUTEX_INIT
+#include <pthread.h>
+#endif
+#include <ruby/thread.h>
+
+#include "oj.h"
+
+// A JSON Lines (NDJSON) file has one document per line so it can be split
+// into chunks at newlines and each chunk scanned on its own. Each chunk is
+// scanned onto a tape by a separate thread. The scan makes no Ruby calls so
+// those threads run while the GVL is held by the Ruby thread that replays the
+// tapes scanned earlier through the delegate and builds the Ruby objects in
+// order. Chunks are handled in batches of one chunk per thread. While one
+// batch is replayed the next batch is scanned. A file that can not be mapped,
+// such as a pipe, is read a chunk at a time so memory use stays bounded.
+
+#define CHUNK_SIZE (4 * 1024 * 1024)
+#define MAX_THREADS 64
+
+typedef struct _chunk {
+    const byte    *json;
+    size_t         len;
+    byte          *buf;  // only used when the file is not mapped
+    size_t         cap;
+    struct _ojTape tape;
+    bool           ok;
+#if HAVE_PTHREAD_MUTEX_INIT
+    pthread_t thread;
+    bool      running;
+#endif
+} * Chunk;
+
+typedef struct _lines {
+    ojParser      p;
+    const char   *path;
+    int           fd;
+    byte         *json;
+    size_t        len;
+    size_t        pos;  // start of the next chunk
+    bool          mapped;
+    bool          eof;
+    byte         *rest;  // partial line read after the last full chunk
+    size_t        rest_len;
+    size_t        rest_cap;
+    int           cnt;     // chunks in a batch
+    Chunk         chunks;  // two batches
+    long          line;    // first line of the chunk being replayed
+    VALUE         docs;
+    volatile bool cancel;  // set to stop the scans
+} * Lines;
+
+static void *scan_chunk(void *ptr) {
+    Chunk c = (Chunk)ptr;
+
+    c->ok = oj_tape_scan(&c->tape, c->json, c->len);
+
+    return NULL;
+}
+
+static void start_scan(Chunk c) {
+#if HAVE_PTHREAD_MUTEX_INIT
+    if ((c->running = (0 == pthread_create(&c->thread, NULL, scan_chunk, c)))) {
+        return;
+    }
+#endif
+    scan_chunk(c);
+}
+
+static void map_chunk(Lines l, Chunk c) {
+    const byte *nl;
+
+    c->len = 0;
+    if (l->len <= l->pos) {
+        return;
+    }
+    c->json = l->json + l->pos;
+    if (l->len - l->pos <= CHUNK_SIZE) {
+        c->len = l->len - l->pos;
+    } else if (NULL != (nl = memchr(c->json + CHUNK_SIZE, '\n', l->len - l->pos - CHUNK_SIZE))) {
+        c->len = nl - c->json + 1;
+    } else {
+        c->len = l->len - l->pos;
+    }
+    l->pos += c->len;
+}
+
+// Fills the chunk with whole lines from the file. The partial line after the
+// last newline is kept for the next chunk. A chunk that has no newline is
+// grown until one is found.
+static void read_chunk(Lines l, Chunk c) {
+    byte   *nl;
+    ssize_t rsize;
+
+    if (c->cap < l->rest_len + CHUNK_SIZE) {
+        c->cap = l->rest_len + CHUNK_SIZE;
+        REALLOC_N(c->buf, byte, c->cap);
+    }
+    memcpy(c->buf, l->rest, l->rest_len);
+    c->len      = l->rest_len;
+    l->rest_len = 0;
+    while (true) {
+        while (!l->eof && c->len < c->cap) {
+            rb_thread_wait_fd(l->fd);
+            if (0 < (rsize = read(l->fd, c->buf + c->len, c->cap - c->len))) {
+                c->len += (size_t)rsize;
+            } else if (0 == rsize) {
+                l->eof = true;
+            } else if (EINTR != errno && EAGAIN != errno) {
+                rb_raise(rb_eIOError, "error reading from %s", l->path);
+            }
+        }
+        if (l->eof) {
+            c->json = c->buf;
+            return;
+        }
+        for (nl = c->buf + c->len - 1; c->buf <= nl && '\n' != *nl; nl--) {
+        }
+        if (c->buf <= nl) {
+            break;
+        }
+        c->cap *= 2;
+        REALLOC_N(c->buf, byte, c->cap);
+    }
+    nl++;
+    l->rest_len = c->buf + c->len - nl;
+    if (l->rest_cap < l->rest_len) {
+        l->rest_cap = l->rest_len;
+        REALLOC_N(l->rest, byte, l->rest_cap);
+    }
+    memcpy(l->rest, nl, l->rest_len);
+    c->json = c->buf;
+    c->len  = nl - c->buf;
+}
+
+static void start_batch(Lines l, Chunk batch) {
+    Chunk c;
+
+    for (c = batch; c < batch + l->cnt; c++) {
+        if (l->mapped) {
+            map_chunk(l, c);
+        } else {
+            read_chunk(l, c);
+        }
+        if (0 < c->len) {
+            start_scan(c);
+        }
+    }
+}
+
+static void *join_threads(void *ptr) {
+#if HAVE_PTHREAD_MUTEX_INIT
+    Lines l = (Lines)ptr;
+    Chunk c;
+
+    for (c = l->chunks; c < l->chunks + l->cnt * 2; c++) {
+        if (c->running) {
+            pthread_join(c->thread, NULL);
+            c->running = false;
+        }
+    }
+#endif
+    return NULL;
+}
+
+// Called by Ruby to interrupt the join.
+static void cancel_scans(void *ptr) {
+    ((Lines)ptr)->cancel = true;
+}
+
+// Waits for the scans of a batch. Scans stopped by an interrupt are started
+// again if none of the pending interrupts raised.
+static void wait_batch(Lines l, Chunk batch) {
+    Chunk c;
+
+    rb_thread_call_without_gvl(join_threads, l, cancel_scans, l);
+    while (l->cancel) {
+        rb_thread_check_ints();
+        l->cancel = false;
+        for (c = batch; c < batch + l->cnt && 0 < c->len; c++) {
+            if (!c->ok) {
+                start_scan(c);
+            }
+        }
+        rb_thread_call_without_gvl(join_threads, l, cancel_scans, l);
+    }
+}
+
+static void collect_doc(ojParser p, void *ctx) {
+    rb_ary_push(((Lines)ctx)->docs, p->result(p));
+    p->start(p);
+}
+
+static VALUE walk_chunks(VALUE x) {
+    Lines l     = (Lines)x;
+    Chunk batch = l->chunks;
+    Chunk next  = l->chunks + l->cnt;
+    Chunk c;
+
+    start_batch(l, batch);
+    while (true) {
+        wait_batch(l, batch);
+        if (0 == batch->len) {
+            break;
+        }
+        start_batch(l, next);
+        for (c = batch; c < batch + l->cnt && 0 < c->len; c++) {
+            if (!c->ok) {
+                rb_raise(oj_json_parser_error_class,
+                         "%s at %ld:%ld",
+                         c->tape.p.err,
+                         l->line + c->tape.p.line - 1,
+                         c->tape.p.col);
+            }
+            oj_tape_replay(&c->tape, l->p, l->line, collect_doc, l);
+            l->line += c->tape.p.line - 1;
+            if (rb_block_given_p()) {
+                rb_yield(l->docs);
+                l->docs = rb_ary_new();
+            }
+        }
+        c     = batch;
+        batch = next;
+        next  = c;
+    }
+    return Qnil;
+}
+
+static VALUE cleanup(VALUE x) {
+    Lines l = (Lines)x;
+    Chunk c;
+
+    // Any scans still running are abandoned.
+    l->cancel = true;
+    rb_thread_call_without_gvl(join_threads, l, NULL, NULL);
+    for (c = l->chunks; c < l->chunks + l->cnt * 2; c++) {
+        oj_tape_cleanup(&c->tape);
+        xfree(c->buf);
+    }
+    xfree(l->chunks);
+    xfree(l->rest);
+#if !IS_WINDOWS
+    if (l->mapped) {
+        munmap(l->json, l->len);
+    }
+#endif
+    close(l->fd);
+
+    return Qnil;
+}
+
+static VALUE load_file(VALUE x) {
+    Lines l = (Lines)x;
+
+#if !IS_WINDOWS
+    struct stat info;
+
+    if (0 == fstat(l->fd, &info) && S_ISREG(info.st_mode) && 0 < info.st_size &&
+        (uint64_t)info.st_size <= (uint64_t)SIZE_MAX) {
+        void *addr = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, l->fd, 0);
+
+        if (MAP_FAILED != addr) {
+            madvise(addr, (size_t)info.st_size, MADV_SEQUENTIAL);
+            l->json   = (byte *)addr;
+            l->len    = (size_t)info.st_size;
+            l->mapped = true;
+        }
+    }
+#endif
+    return walk_chunks(x);
+}
+
+static void *open_file(void *x) {
+    Lines l = (Lines)x;
+
+    l->fd = open(l->path, O_RDONLY);
+
+    return (void *)(intptr_t)l->fd;
+}
+
+VALUE oj_parser_file_lines(ojParser p, const char *path) {
+    struct _lines l;
+    int           cnt = p->threads;
+    int           i;
+
+    if (cnt <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        cnt = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (cnt <= 0) {
+            cnt = 1;
+        }
+    }
+    if (MAX_THREADS < cnt) {
+        cnt = MAX_THREADS;
+    }
+    memset(&l, 0, sizeof(l));
+    l.p    = p;
+    l.path = path;
+    l.cnt  = cnt;
+    l.line = 1;
+    // Opening a named pipe waits for a writer so the GVL is released.
+    while (0 > (intptr_t)rb_thread_call_without_gvl(open_file, &l, RUBY_UBF_IO, NULL) && EINTR == errno) {
+        rb_thread_check_ints();
+    }
+    if (0 > l.fd) {
+        rb_raise(rb_eIOError, "error opening %s", path);
+    }
+    l.docs   = rb_ary_new();
+    l.chunks = ALLOC_N(struct _chunk, cnt * 2);
+    memset(l.chunks, 0, sizeof(struct _chunk) * cnt * 2);
+    for (i = 0; i < cnt * 2; i++) {
+        oj_tape_init(&l.chunks[i].tape);
+        l.chunks[i].tape.stop = &l.cancel;
+    }
+    rb_ensure(load_file, (VALUE)&l, cleanup, (VALUE)&l);
+
+    if (rb_block_given_p()) {
+        return Qnil;
+    }
+    return l.docs;
+}
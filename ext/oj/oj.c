@@ -290,7 +290,7 @@ struct _options oj_default_options = {
  * - *:ignore* [_nil_|_Array_] either nil or an Array of classes to ignore when dumping
  * - *:ignore_under* [_Boolean_] if true then attributes that start with _ are ignored when dumping in
  *object or custom mode.
- * - *:cache_keys* [_Boolean_] if true then hash keys are cached if less than 35 bytes.
+ * - *:cache_keys* [_Boolean_] if true then hash keys are cached if no more than 1024 bytes.
  * - *:cache_str* [_Fixnum_] maximum string value length to cache (strings less than this are cached)
  * - *:integer_range* [_Range_] Dump integers outside range as strings.
  * - *:trace* [_true,_|_false_] Trace all load and dump calls, default is false (trace is off)
@@ -1400,6 +1400,68 @@ static VALUE to_stream(int argc, VALUE *argv, VALUE self) {
     return Qnil;
 }
 
+/* Document-method: cache_stats
+ * call-seq: cache_stats()
+ *
+ * Returns the counters and sizes of the caches shared by all the parse
+ * modes. The Hash has an entry for each of the :str, :sym, :attr, and
+ * :class caches. Each entry is a Hash with the following keys.
+ *
+ * - *:size* [_Integer_] number of slots in the table
+ * - *:count* [_Integer_] number of cached entries
+ * - *:hits* [_Integer_] lookups that found a cached entry
+ * - *:misses* [_Integer_] lookups that had to create a new value
+ * - *:rehashes* [_Integer_] times the table was copied when it filled up
+ * - *:expunged* [_Integer_] unused entries dropped during a rehash
+ * - *:retired* [_Integer_] old tables waiting to be freed on the next GC
+ * - *:permanent* [_Integer_] keys added with _register_keys_
+ * - *:bytes* [_Integer_] memory held by the cache
+ *
+ * Returns [_Hash_]
+ */
+static VALUE cache_stats(VALUE self) {
+    return oj_cache_stats();
+}
+
+static bool symbols_opt(int argc, VALUE *argv) {
+    if (0 < argc && T_HASH == rb_type(argv[argc - 1])) {
+        return RTEST(rb_hash_lookup(argv[argc - 1], ID2SYM(rb_intern("symbols"))));
+    }
+    return false;
+}
+
+/* Document-method: register_keys
+ * call-seq: register_keys(keys, symbols: false)
+ *
+ * Adds keys to the key cache as permanent entries that are never expunged.
+ * Registered keys are found with a perfect hash before the rest of the
+ * cache is searched so the first documents parsed after a start do not pay
+ * for a cold cache. Keys can be registered more than once and in more than
+ * one call.
+ *
+ * - *keys* [_Array_] Strings or Symbols to register
+ * - *symbols* [_Boolean_] if true the keys are registered in the Symbol key cache used with _:symbol_keys_
+ */
+static VALUE register_keys(int argc, VALUE *argv, VALUE self) {
+    if (argc < 1) {
+        rb_raise(rb_eArgError, "Wrong number of arguments to register_keys().");
+    }
+    oj_register_keys(*argv, symbols_opt(argc - 1, argv + 1));
+
+    return Qnil;
+}
+
+/* Document-method: registered_keys
+ * call-seq: registered_keys(symbols: false)
+ *
+ * Returns the keys added with _register_keys_ as an Array of Strings.
+ *
+ * - *symbols* [_Boolean_] if true the keys registered in the Symbol key cache are returned
+ */
+static VALUE registered_keys(int argc, VALUE *argv, VALUE self) {
+    return oj_registered_keys(symbols_opt(argc, argv));
+}
+
 /* Document-method: register_odd
  * call-seq: register_odd(clas, create_object, create_method, *members)
  *
@@ -1804,6 +1866,10 @@ void Init_oj(void) {
     rb_define_module_function(Oj, "register_odd", register_odd, -1);
     rb_define_module_function(Oj, "register_odd_raw", register_odd_raw, -1);
 
+    rb_define_module_function(Oj, "cache_stats", cache_stats, 0);
+    rb_define_module_function(Oj, "register_keys", register_keys, -1);
+    rb_define_module_function(Oj, "registered_keys", registered_keys, -1);
+
     rb_define_module_function(Oj, "saj_parse", oj_saj_parse, -1);
     rb_define_module_function(Oj, "sc_parse", oj_sc_parse, -1);
 
@@ -2,25 +2,35 @@
 
 #include "parser.h"
 
+#include <errno.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if !IS_WINDOWS
+#include <sys/mman.h>
+#endif
+#include <ruby/thread.h>
 
+#include "lemire.h"
 #include "oj.h"
+#include "simd.h"
+#include "tape.h"
+
+#ifdef HAVE_RB_IO_BUFFER_GET_BYTES_FOR_READING
+#include <ruby/io/buffer.h>
+#endif
 
 #define DEBUG 0
 
-#define USE_THREAD_LIMIT 0
-// #define USE_THREAD_LIMIT 100000
-#define MAX_EXP 4932
+// Reads from pipes and streams are usually limited by the pipe buffer so a
+// larger size only helps a little there but saves calls for files.
+#define DEFAULT_READ_SIZE 65536
+#define MIN_READ_SIZE 1024
+
 // max in the pow_map which is the limit for double
 #define MAX_POW 308
 
 #define MIN_SLEEP (1000000000LL / (double)CLOCKS_PER_SEC)
-// 9,223,372,036,854,775,807
-#define BIG_LIMIT LLONG_MAX / 10
-#define FRAC_LIMIT 10000000000000000ULL
-
-// Give better performance with indented JSON but worse with unindented.
-//#define SPACE_JUMP
 
 enum {
     SKIP_CHAR        = 'a',
@@ -76,7 +86,7 @@ enum {
 /*
 0123456789abcdef0123456789abcdef */
 static const char value_map[257] = "\
-X........ab..a..................\
+.........ab..a..................\
 a.i..........f..ghhhhhhhhh......\
 ...........................k.m..\
 ......e.......c.....d......l.n..\
@@ -418,6 +428,118 @@ static long double pow_map[309] = {
 
 static VALUE parser_class;
 
+// String scanners return a pointer to the first byte that is not a plain
+// string character; a quote, backslash, control character, or the start of a
+// multibyte UTF-8 sequence. The vector versions only load complete vectors
+// before end and then let the byte map version finish up.
+static const byte *scan_str_map(const byte *b, const byte *end) {
+    for (; b < end && STR_OK == string_map[*b]; b++) {
+    }
+    return b;
+}
+
+#if OJ_X86_SIMD
+// Bytes are compared as signed so anything with the high bit set is less than
+// a space just like the control characters are.
+static const byte *scan_str_sse2(const byte *b, const byte *end) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(' ');
+
+    for (; b + 16 <= end; b += 16) {
+        __m128i v    = _mm_loadu_si128((const __m128i *)b);
+        __m128i hit  = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)),
+                                   _mm_cmplt_epi8(v, space));
+        int     mask = _mm_movemask_epi8(hit);
+
+        if (0 != mask) {
+            return b + __builtin_ctz(mask);
+        }
+    }
+    return scan_str_map(b, end);
+}
+
+OJ_TARGET_AVX2
+static const byte *scan_str_avx2(const byte *b, const byte *end) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i slash = _mm256_set1_epi8('\\');
+    const __m256i space = _mm256_set1_epi8(' ');
+
+    for (; b + 32 <= end; b += 32) {
+        __m256i  v    = _mm256_loadu_si256((const __m256i *)b);
+        __m256i  hit  = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, slash)),
+                                      _mm256_cmpgt_epi8(space, v));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(hit);
+
+        if (0 != mask) {
+            return b + __builtin_ctz(mask);
+        }
+    }
+    return scan_str_sse2(b, end);
+}
+
+OJ_TARGET_AVX512
+static const byte *scan_str_avx512(const byte *b, const byte *end) {
+    const __m512i quote = _mm512_set1_epi8('"');
+    const __m512i slash = _mm512_set1_epi8('\\');
+    const __m512i space = _mm512_set1_epi8(' ');
+
+    for (; b + 64 <= end; b += 64) {
+        __m512i  v    = _mm512_loadu_si512((const void *)b);
+        uint64_t mask = _mm512_cmpeq_epi8_mask(v, quote) | _mm512_cmpeq_epi8_mask(v, slash) |
+                        _mm512_cmplt_epi8_mask(v, space);
+
+        if (0 != mask) {
+            return b + __builtin_ctzll(mask);
+        }
+    }
+    return scan_str_sse2(b, end);
+}
+#endif
+
+static const byte *(*scan_str_func)(const byte *b, const byte *end) = scan_str_map;
+
+// Skips spaces, tabs, and carriage returns but not newlines since those are
+// counted. Compact JSON has no runs of white space so the first byte is
+// checked with the byte map before anything else. Indentation is usually
+// less than a vector wide so SSE2 is used without the run time dispatch of
+// the string scanner.
+inline static const byte *skip_space(const byte *b, const byte *end) {
+    if (end <= b || SKIP_CHAR != space_map[*b]) {
+        return b;
+    }
+#if OJ_X86_SIMD
+    {
+        const __m128i space = _mm_set1_epi8(' ');
+
+        for (; b + 16 <= end; b += 16) {
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)b), space)) ^ 0xFFFF;
+
+            if (0 != mask) {
+                b += __builtin_ctz(mask);
+                break;
+            }
+        }
+    }
+#endif
+    for (; b < end && SKIP_CHAR == space_map[*b]; b++) {
+    }
+    return b;
+}
+
+// Keys and many values are short so a few bytes are checked with the byte map
+// before paying for the call to the vector scanner.
+inline static const byte *scan_str(const byte *b, const byte *end) {
+    const byte *short_end = (b + 8 < end) ? b + 8 : end;
+
+    for (; b < short_end; b++) {
+        if (STR_OK != string_map[*b]) {
+            return b;
+        }
+    }
+    return scan_str_func(b, end);
+}
+
 // Works with extended unicode as well. \Uffffffff if support is desired in
 // the future.
 static size_t unicodeToUtf8(uint32_t code, byte *buf) {
@@ -462,12 +584,24 @@ static void parser_reset(ojParser p) {
     p->map      = value_map;
     p->next_map = NULL;
     p->depth    = 0;
+    p->stop_one = false;
+    p->consumed = 0;
+    p->doc_done = NULL;
+    p->feeding  = false;
+    p->line     = 1;
+    p->col      = -1;
 }
 
 static void parse_error(ojParser p, const char *fmt, ...) {
     va_list ap;
     char    buf[256];
 
+    if (NULL != p->err_jump) {
+        va_start(ap, fmt);
+        vsnprintf(p->err, sizeof(p->err), fmt, ap);
+        va_end(ap);
+        longjmp(*p->err_jump, 1);
+    }
     va_start(ap, fmt);
     vsnprintf(buf, sizeof(buf), fmt, ap);
     va_end(ap);
@@ -488,7 +622,12 @@ static void byte_error(ojParser p, byte b) {
     case 's':  // string_map
         parse_error(p, "invalid JSON character 0x%02x", b);
         break;
-    default: parse_error(p, "unexpected character '%c' in '%c' mode", b, p->map[256]); break;
+    default:
+        if (b < 0x20) {
+            parse_error(p, "unexpected character 0x%02x in '%c' mode", b, p->map[256]);
+        }
+        parse_error(p, "unexpected character '%c' in '%c' mode", b, p->map[256]);
+        break;
     }
 }
 
@@ -502,13 +641,27 @@ static void calc_num(ojParser p) {
         p->funcs[p->stack[p->depth]].add_int(p);
         break;
     case OJ_DECIMAL: {
-        long double d = (long double)p->num.fixnum;
-
+        long double d;
+        double      dub;
+        int64_t     exp = p->num.exp_neg ? -(int64_t)p->num.exp : (int64_t)p->num.exp;
+
+        // The fixnum holds all the significant digits so it is exact and the
+        // correctly rounded result can almost always be found quickly.
+        if (oj_lemire_double((uint64_t)p->num.fixnum, exp - p->num.shift, p->num.neg, &dub)) {
+            p->num.dub = dub;
+            p->funcs[p->stack[p->depth]].add_float(p);
+            break;
+        }
+        d = (long double)p->num.fixnum;
         if (p->num.neg) {
             d = -d;
         }
         if (0 < p->num.shift) {
-            d /= pow_map[p->num.shift];
+            if (MAX_POW < p->num.shift) {
+                d /= powl(10.0L, (long double)p->num.shift);
+            } else {
+                d /= pow_map[p->num.shift];
+            }
         }
         if (0 < p->num.exp) {
             long double x;
@@ -536,6 +689,33 @@ static void calc_num(ojParser p) {
     p->type = OJ_NONE;
 }
 
+// Reads eight digits at a time while they are available and fit. The byte at
+// a time loop finishes up and handles the change to a big number.
+inline static const byte *read_digits8(ojParser p, const byte *b, const byte *end) {
+    uint64_t v;
+
+    for (; b + 8 <= end && p->num.fixnum <= DIGITS8_LIMIT; b += 8) {
+        if (!oj_is_8digits(v = oj_load8(b))) {
+            break;
+        }
+        p->num.fixnum = p->num.fixnum * 100000000 + (int64_t)oj_8digits(v);
+    }
+    return b;
+}
+
+inline static const byte *read_frac8(ojParser p, const byte *b, const byte *end) {
+    uint64_t v;
+
+    for (; b + 8 <= end && p->num.fixnum < (int64_t)FRAC8_LIMIT; b += 8) {
+        if (!oj_is_8digits(v = oj_load8(b))) {
+            break;
+        }
+        p->num.fixnum = p->num.fixnum * 100000000 + (int64_t)oj_8digits(v);
+        p->num.shift += 8;
+    }
+    return b;
+}
+
 static void big_change(ojParser p) {
     char    buf[32];
     int64_t i   = p->num.fixnum;
@@ -558,19 +738,31 @@ static void big_change(ojParser p) {
         break;
     case OJ_DECIMAL: {
         int shift = p->num.shift;
+        int cnt;
 
-        for (len = sizeof(buf) - 1; 0 < i; len--, i /= 10, shift--) {
-            if (0 == shift) {
-                buf[len] = '.';
-                len--;
-            }
+        for (len = sizeof(buf) - 1; 0 < i; len--, i /= 10) {
             buf[len] = '0' + (i % 10);
         }
+        cnt = (int)sizeof(buf) - 1 - len;
         if (p->num.neg) {
-            buf[len] = '-';
-            len--;
+            buf_append(&p->buf, '-');
+        }
+        // Leading zeros in the fraction are not in the fixnum so they must be
+        // put back from the shift.
+        if (cnt <= shift) {
+            buf_append(&p->buf, '0');
+            buf_append(&p->buf, '.');
+            for (; cnt < shift; shift--) {
+                buf_append(&p->buf, '0');
+            }
+            buf_append_string(&p->buf, buf + len + 1, cnt);
+        } else {
+            buf_append_string(&p->buf, buf + len + 1, cnt - shift);
+            if (0 < shift) {
+                buf_append(&p->buf, '.');
+                buf_append_string(&p->buf, buf + len + 1 + cnt - shift, shift);
+            }
         }
-        buf_append_string(&p->buf, buf + len + 1, sizeof(buf) - len - 1);
         if (0 < p->num.exp) {
             int  x = p->num.exp;
             int  d, div;
@@ -584,6 +776,7 @@ static void big_change(ojParser p) {
                 d = x / div % 10;
                 if (started || 0 < d) {
                     buf_append(&p->buf, '0' + d);
+                    started = true;
                 }
             }
         }
@@ -594,45 +787,44 @@ static void big_change(ojParser p) {
     }
 }
 
-static void parse(ojParser p, const byte *json) {
+// Files and streams are parsed a chunk at a time. The checks for an
+// incomplete document and the conversion of a number at the very end are only
+// made on the last chunk which may be empty.
+static void parse_chunk(ojParser p, const byte *json, size_t len, bool last) {
     const byte *start;
-    const byte *b = json;
+    const byte *b   = json;
+    const byte *end = json + len;
     int         i;
+    char        c;
 
-    p->line = 1;
-    p->col  = -1;
 #if DEBUG
-    printf("*** parse - mode: %c %s\n", p->map[256], (const char *)json);
+    printf("*** parse - mode: %c %.*s\n", p->map[256], (int)len, (const char *)json);
 #endif
-    for (; '\0' != *b; b++) {
+    for (; b < end; b++) {
 #if DEBUG
-        printf("*** parse - mode: %c %02x %s => %c\n", p->map[256], *b, b, p->map[*b]);
+        printf("*** parse - mode: %c %02x => %c\n", p->map[256], *b, p->map[*b]);
 #endif
-        switch (p->map[*b]) {
+        switch (c = p->map[*b]) {
         case SKIP_NEWLINE:
             p->line++;
             p->col = b - json;
             b++;
-#ifdef SPACE_JUMP
-            // for (uint32_t *sj = (uint32_t*)b; 0x20202020 == *sj; sj++) { b += 4; }
-            for (uint16_t *sj = (uint16_t *)b; 0x2020 == *sj; sj++) {
-                b += 2;
-            }
-#endif
-            for (; SKIP_CHAR == space_map[*b]; b++) {
-            }
+            b = skip_space(b, end);
             b--;
             break;
         case COLON_COLON: p->map = value_map; break;
-        case SKIP_CHAR: break;
+        case SKIP_CHAR:
+            b = skip_space(b + 1, end);
+            b--;
+            break;
         case KEY_QUOTE:
             b++;
             p->key.tail = p->key.head;
+            p->key_cr   = CR_7BIT;
             start       = b;
-            for (; STR_OK == string_map[*b]; b++) {
-            }
+            b           = scan_str(b, end);
             buf_append_string(&p->key, (const char *)start, b - start);
-            if ('"' == *b) {
+            if (b < end && '"' == *b) {
                 p->map = colon_map;
                 break;
             }
@@ -651,10 +843,10 @@ static void parse(ojParser p, const byte *json) {
             b++;
             start       = b;
             p->buf.tail = p->buf.head;
-            for (; STR_OK == string_map[*b]; b++) {
-            }
+            p->buf_cr   = CR_7BIT;
+            b           = scan_str(b, end);
             buf_append_string(&p->buf, (const char *)start, b - start);
-            if ('"' == *b) {
+            if (b < end && '"' == *b) {
                 p->cur = b - json;
                 p->funcs[p->stack[p->depth]].add_str(p);
                 p->map = (0 == p->depth) ? value_map : after_map;
@@ -665,6 +857,11 @@ static void parse(ojParser p, const byte *json) {
             p->next_map = (0 == p->depth) ? value_map : after_map;
             break;
         case OPEN_OBJECT:
+            if (MAX_DEPTH <= p->depth) {
+                p->col = b - json - p->col;
+                parse_error(p, "too deeply nested");
+                return;
+            }
             p->cur = b - json;
             p->funcs[p->stack[p->depth]].open_object(p);
             p->depth++;
@@ -687,6 +884,11 @@ static void parse(ojParser p, const byte *json) {
             p->funcs[p->stack[p->depth]].close_object(p);
             break;
         case OPEN_ARRAY:
+            if (MAX_DEPTH <= p->depth) {
+                p->col = b - json - p->col;
+                parse_error(p, "too deeply nested");
+                return;
+            }
             p->cur = b - json;
             p->funcs[p->stack[p->depth]].open_array(p);
             p->depth++;
@@ -747,14 +949,12 @@ static void parse(ojParser p, const byte *json) {
             p->num.exp_neg = false;
             p->num.len     = 0;
             p->map         = digit_map;
-            for (; NUM_DIGIT == digit_map[*b]; b++) {
-                uint64_t x = (uint64_t)p->num.fixnum * 10 + (uint64_t)(*b - '0');
-
-                // Tried just checking for an int less than zero but that
-                // fails when optimization is on for some reason with the
-                // clang compiler so us a bit mask instead.
-                if (x < BIG_LIMIT) {
-                    p->num.fixnum = (int64_t)x;
+            b              = read_digits8(p, b, end);
+            for (; b < end && NUM_DIGIT == digit_map[*b]; b++) {
+                // The check is made before the multiply so there is no
+                // overflow for clang to optimize away.
+                if (p->num.fixnum < BIG_LIMIT || (BIG_LIMIT == p->num.fixnum && *b <= '7')) {
+                    p->num.fixnum = p->num.fixnum * 10 + (int64_t)(*b - '0');
                 } else {
                     big_change(p);
                     p->map = big_digit_map;
@@ -764,11 +964,10 @@ static void parse(ojParser p, const byte *json) {
             b--;
             break;
         case NUM_DIGIT:
-            for (; NUM_DIGIT == digit_map[*b]; b++) {
-                uint64_t x = p->num.fixnum * 10 + (uint64_t)(*b - '0');
-
-                if (x < BIG_LIMIT) {
-                    p->num.fixnum = (int64_t)x;
+            b = read_digits8(p, b, end);
+            for (; b < end && NUM_DIGIT == digit_map[*b]; b++) {
+                if (p->num.fixnum < BIG_LIMIT || (BIG_LIMIT == p->num.fixnum && *b <= '7')) {
+                    p->num.fixnum = p->num.fixnum * 10 + (int64_t)(*b - '0');
                 } else {
                     big_change(p);
                     p->map = big_digit_map;
@@ -783,14 +982,16 @@ static void parse(ojParser p, const byte *json) {
             break;
         case NUM_FRAC:
             p->map = frac_map;
-            for (; NUM_FRAC == frac_map[*b]; b++) {
-                uint64_t x = p->num.fixnum * 10 + (uint64_t)(*b - '0');
-
-                if (x < FRAC_LIMIT) {
-                    p->num.fixnum = (int64_t)x;
+            b      = read_frac8(p, b, end);
+            for (; b < end && NUM_FRAC == frac_map[*b]; b++) {
+                if (p->num.fixnum < (int64_t)(FRAC_LIMIT / 10)) {
+                    p->num.fixnum = p->num.fixnum * 10 + (int64_t)(*b - '0');
                     p->num.shift++;
                 } else {
                     big_change(p);
+                    if (0 == p->num.shift) {
+                        buf_append(&p->buf, '.');
+                    }
                     p->map = big_frac_map;
                     break;
                 }
@@ -803,11 +1004,11 @@ static void parse(ojParser p, const byte *json) {
             break;
         case NUM_ZERO: p->map = zero_map; break;
         case NEG_DIGIT:
-            for (; NUM_DIGIT == digit_map[*b]; b++) {
-                uint64_t x = p->num.fixnum * 10 + (uint64_t)(*b - '0');
-
-                if (x < BIG_LIMIT) {
-                    p->num.fixnum = (int64_t)x;
+            p->map = digit_map;
+            b      = read_digits8(p, b, end);
+            for (; b < end && NUM_DIGIT == digit_map[*b]; b++) {
+                if (p->num.fixnum < BIG_LIMIT || (BIG_LIMIT == p->num.fixnum && *b <= '7')) {
+                    p->num.fixnum = p->num.fixnum * 10 + (int64_t)(*b - '0');
                 } else {
                     big_change(p);
                     p->map = big_digit_map;
@@ -815,7 +1016,6 @@ static void parse(ojParser p, const byte *json) {
                 }
             }
             b--;
-            p->map = digit_map;
             break;
         case EXP_SIGN:
             p->num.exp_neg = ('-' == *b);
@@ -823,7 +1023,7 @@ static void parse(ojParser p, const byte *json) {
             break;
         case EXP_DIGIT:
             p->map = exp_map;
-            for (; NUM_DIGIT == digit_map[*b]; b++) {
+            for (; b < end && NUM_DIGIT == digit_map[*b]; b++) {
                 int16_t x = p->num.exp * 10 + (int16_t)(*b - '0');
 
                 if (x <= MAX_EXP) {
@@ -838,7 +1038,7 @@ static void parse(ojParser p, const byte *json) {
             break;
         case BIG_DIGIT:
             start = b;
-            for (; NUM_DIGIT == digit_map[*b]; b++) {
+            for (; b < end && NUM_DIGIT == digit_map[*b]; b++) {
             }
             buf_append_string(&p->buf, (const char *)start, b - start);
             b--;
@@ -850,7 +1050,7 @@ static void parse(ojParser p, const byte *json) {
         case BIG_FRAC:
             p->map = big_frac_map;
             start  = b;
-            for (; NUM_FRAC == frac_map[*b]; b++) {
+            for (; b < end && NUM_FRAC == frac_map[*b]; b++) {
             }
             buf_append_string(&p->buf, (const char *)start, b - start);
             b--;
@@ -865,7 +1065,7 @@ static void parse(ojParser p, const byte *json) {
             break;
         case BIG_EXP:
             start = b;
-            for (; NUM_DIGIT == digit_map[*b]; b++) {
+            for (; b < end && NUM_DIGIT == digit_map[*b]; b++) {
             }
             buf_append_string(&p->buf, (const char *)start, b - start);
             b--;
@@ -874,31 +1074,27 @@ static void parse(ojParser p, const byte *json) {
         case NUM_SPC:
             p->cur = b - json;
             calc_num(p);
+            p->map = (0 == p->depth) ? value_map : after_map;
             break;
         case NUM_NEWLINE:
             p->cur = b - json;
             calc_num(p);
+            p->map = (0 == p->depth) ? value_map : after_map;
+            p->line++;
+            p->col = b - json;
             b++;
-#ifdef SPACE_JUMP
-            // for (uint32_t *sj = (uint32_t*)b; 0x20202020 == *sj; sj++) { b += 4; }
-            for (uint16_t *sj = (uint16_t *)b; 0x2020 == *sj; sj++) {
-                b += 2;
-            }
-#endif
-            for (; SKIP_CHAR == space_map[*b]; b++) {
-            }
+            b = skip_space(b, end);
             b--;
             break;
         case STR_OK:
             start = b;
-            for (; STR_OK == string_map[*b]; b++) {
-            }
+            b     = scan_str(b, end);
             if (':' == p->next_map[256]) {
                 buf_append_string(&p->key, (const char *)start, b - start);
             } else {
                 buf_append_string(&p->buf, (const char *)start, b - start);
             }
-            if ('"' == *b) {
+            if (b < end && '"' == *b) {
                 p->cur = b - json;
                 p->funcs[p->stack[p->depth]].add_str(p);
                 p->map = p->next_map;
@@ -927,8 +1123,10 @@ static void parse(ojParser p, const byte *json) {
                 if (0 < ulen) {
                     if (':' == p->next_map[256]) {
                         buf_append_string(&p->key, (const char *)utf8, ulen);
+                        p->key_cr = oj_ucode_cr(p->key_cr, p->ucode);
                     } else {
                         buf_append_string(&p->buf, (const char *)utf8, ulen);
+                        p->buf_cr = oj_ucode_cr(p->buf_cr, p->ucode);
                     }
                 } else {
                     parse_error(p, "invalid unicode");
@@ -946,8 +1144,9 @@ static void parse(ojParser p, const byte *json) {
             p->map = string_map;
             break;
         case UTF1:
-            p->ri  = 1;
-            p->map = utf_map;
+            p->ri   = 1;
+            p->lead = *b;
+            p->map  = utf_map;
             if (':' == p->next_map[256]) {
                 buf_append(&p->key, *b);
             } else {
@@ -955,8 +1154,9 @@ static void parse(ojParser p, const byte *json) {
             }
             break;
         case UTF2:
-            p->ri  = 2;
-            p->map = utf_map;
+            p->ri   = 2;
+            p->lead = *b;
+            p->map  = utf_map;
             if (':' == p->next_map[256]) {
                 buf_append(&p->key, *b);
             } else {
@@ -964,8 +1164,9 @@ static void parse(ojParser p, const byte *json) {
             }
             break;
         case UTF3:
-            p->ri  = 3;
-            p->map = utf_map;
+            p->ri   = 3;
+            p->lead = *b;
+            p->map  = utf_map;
             if (':' == p->next_map[256]) {
                 buf_append(&p->key, *b);
             } else {
@@ -976,15 +1177,22 @@ static void parse(ojParser p, const byte *json) {
             p->ri--;
             if (':' == p->next_map[256]) {
                 buf_append(&p->key, *b);
+                if (0 != p->lead) {
+                    p->key_cr = oj_utf8_cr(p->key_cr, p->lead, *b);
+                }
             } else {
                 buf_append(&p->buf, *b);
+                if (0 != p->lead) {
+                    p->buf_cr = oj_utf8_cr(p->buf_cr, p->lead, *b);
+                }
             }
+            p->lead = 0;
             if (p->ri <= 0) {
                 p->map = string_map;
             }
             break;
         case VAL_NULL:
-            if ('u' == b[1] && 'l' == b[2] && 'l' == b[3]) {
+            if (b + 3 < end && 'u' == b[1] && 'l' == b[2] && 'l' == b[3]) {
                 b += 3;
                 p->cur = b - json;
                 p->funcs[p->stack[p->depth]].add_null(p);
@@ -994,7 +1202,7 @@ static void parse(ojParser p, const byte *json) {
             p->ri     = 0;
             *p->token = *b++;
             for (i = 1; i < 4; i++) {
-                if ('\0' == *b) {
+                if (end <= b) {
                     p->ri = i;
                     break;
                 } else {
@@ -1010,7 +1218,7 @@ static void parse(ojParser p, const byte *json) {
             parse_error(p, "expected null");
             return;
         case VAL_TRUE:
-            if ('r' == b[1] && 'u' == b[2] && 'e' == b[3]) {
+            if (b + 3 < end && 'r' == b[1] && 'u' == b[2] && 'e' == b[3]) {
                 b += 3;
                 p->cur = b - json;
                 p->funcs[p->stack[p->depth]].add_true(p);
@@ -1020,7 +1228,7 @@ static void parse(ojParser p, const byte *json) {
             p->ri     = 0;
             *p->token = *b++;
             for (i = 1; i < 4; i++) {
-                if ('\0' == *b) {
+                if (end <= b) {
                     p->ri = i;
                     break;
                 } else {
@@ -1036,7 +1244,7 @@ static void parse(ojParser p, const byte *json) {
             parse_error(p, "expected true");
             return;
         case VAL_FALSE:
-            if ('a' == b[1] && 'l' == b[2] && 's' == b[3] && 'e' == b[4]) {
+            if (b + 4 < end && 'a' == b[1] && 'l' == b[2] && 's' == b[3] && 'e' == b[4]) {
                 b += 4;
                 p->cur = b - json;
                 p->funcs[p->stack[p->depth]].add_false(p);
@@ -1046,7 +1254,7 @@ static void parse(ojParser p, const byte *json) {
             p->ri     = 0;
             *p->token = *b++;
             for (i = 1; i < 5; i++) {
-                if ('\0' == *b) {
+                if (end <= b) {
                     p->ri = i;
                     break;
                 } else {
@@ -1107,14 +1315,35 @@ static void parse(ojParser p, const byte *json) {
                 return;
             }
             break;
-        case CHAR_ERR: byte_error(p, *b); return;
+        case CHAR_ERR:
+            p->col = b - json - p->col;
+            byte_error(p, *b);
+            return;
         default: break;
         }
-        if (0 == p->depth && 'v' == p->map[256] && p->just_one) {
-            p->map = trail_map;
+        // Back in the value map at the top level on anything other than
+        // white space means a value was just completed.
+        if (0 == p->depth && 'v' == p->map[256] && SKIP_CHAR != c && SKIP_NEWLINE != c) {
+            if (p->stop_one) {
+                for (b++; b < end && (SKIP_CHAR == space_map[*b] || SKIP_NEWLINE == space_map[*b]); b++) {
+                }
+                p->consumed = b - json;
+                return;
+            }
+            if (NULL != p->doc_done) {
+                p->doc_done(p);
+            } else if (p->just_one) {
+                p->map = trail_map;
+            }
         }
     }
+    if (!last) {
+        // The column is relative to the start of the next chunk.
+        p->col -= (long)len;
+        return;
+    }
     if (0 < p->depth) {
+        p->col = b - json - p->col;
         parse_error(p, "parse error, not closed");
     }
     if (0 == p->depth) {
@@ -1122,18 +1351,36 @@ static void parse(ojParser p, const byte *json) {
         case '0':
         case 'd':
         case 'f':
-        case 'z':
         case 'X':
         case 'D':
         case 'g':
-        case 'B':
         case 'Y':
             p->cur = b - json;
             calc_num(p);
+            p->map = value_map;
+            if (NULL != p->doc_done) {
+                p->doc_done(p);
+            }
             break;
         }
+        // A range holds complete elements so there is no more to come.
+        if (p->stop_one && 'v' != p->map[256]) {
+            p->col = b - json - p->col;
+            parse_error(p, "parse error, not complete");
+        }
     }
-    return;
+}
+
+static void parse(ojParser p, const byte *json, size_t len) {
+    parse_chunk(p, json, len, true);
+}
+
+// Parses a complete document or stream of documents from the start. With
+// err_jump set and delegate functions that make no Ruby calls this can be
+// called without the GVL.
+void oj_parser_scan(ojParser p, const byte *json, size_t len) {
+    parser_reset(p);
+    parse(p, json, len);
 }
 
 static void parser_free(void *ptr) {
@@ -1145,6 +1392,10 @@ static void parser_free(void *ptr) {
     p = (ojParser)ptr;
     buf_cleanup(&p->key);
     buf_cleanup(&p->buf);
+    if (NULL != p->tape) {
+        oj_tape_cleanup(p->tape);
+        xfree(p->tape);
+    }
     p->free(p);
     xfree(ptr);
 }
@@ -1160,10 +1411,47 @@ static void parser_mark(void *ptr) {
     }
 }
 
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+static void parser_compact(void *ptr) {
+    ojParser p = (ojParser)ptr;
+
+    if (NULL != p && NULL != p->compact) {
+        p->compact(p);
+    }
+}
+#endif
+
+static const rb_data_type_t oj_parser_type = {
+    "Oj/parser",
+    {
+        parser_mark,
+        parser_free,
+        NULL,
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+        parser_compact,
+#endif
+    },
+    0,
+    0,
+};
+
 extern void oj_set_parser_validator(ojParser p);
 extern void oj_set_parser_saj(ojParser p);
 extern void oj_set_parser_usual(ojParser p);
 extern void oj_set_parser_debug(ojParser p);
+extern void oj_set_parser_lazy(ojParser p);
+extern void oj_lazy_init(VALUE parser_class);
+extern void oj_set_parser_project(ojParser p);
+extern void oj_set_parser_schema(ojParser p);
+
+static void read_size_set(ojParser p, VALUE value) {
+    long size = NUM2LONG(value);
+
+    if (size < MIN_READ_SIZE) {
+        rb_raise(rb_eArgError, "read_size must be at least %d", MIN_READ_SIZE);
+    }
+    p->read_size = (size_t)size;
+}
 
 static int opt_cb(VALUE rkey, VALUE value, VALUE ptr) {
     ojParser    p   = (ojParser)ptr;
@@ -1184,6 +1472,23 @@ static int opt_cb(VALUE rkey, VALUE value, VALUE ptr) {
     if ((long)sizeof(set_key) - 1 <= klen) {
         return ST_CONTINUE;
     }
+    // Options for the parser itself are not passed to the delegate.
+    if (0 == strncmp("mmap", key, klen) && 4 == klen) {
+        p->use_mmap = (Qtrue == value);
+        return ST_CONTINUE;
+    }
+    if (0 == strncmp("read_size", key, klen) && 9 == klen) {
+        read_size_set(p, value);
+        return ST_CONTINUE;
+    }
+    if (0 == strncmp("release_gvl", key, klen) && 11 == klen) {
+        p->release_gvl = NUM2ULONG(value);
+        return ST_CONTINUE;
+    }
+    if (0 == strncmp("threads", key, klen) && 7 == klen) {
+        p->threads = NUM2INT(value);
+        return ST_CONTINUE;
+    }
     memcpy(set_key, key, klen);
     set_key[klen]     = '=';
     set_key[klen + 1] = '\0';
@@ -1198,7 +1503,9 @@ static int opt_cb(VALUE rkey, VALUE value, VALUE ptr) {
  * Creates a new Parser with the specified mode. If no mode is provided
  * validation is assumed. Optional arguments can be provided that match the
  * mode. For example with the :usual mode the call might look like
- * Oj::Parser.new(:usual, cache_keys: true).
+ * Oj::Parser.new(:usual, cache_keys: true). The _mmap_, _read_size_,
+ * _release_gvl_, and _threads_ options are handled by the parser itself and
+ * not the delegate.
  */
 static VALUE parser_new(int argc, VALUE *argv, VALUE self) {
     ojParser p = ALLOC(struct _ojParser);
@@ -1210,7 +1517,9 @@ static VALUE parser_new(int argc, VALUE *argv, VALUE self) {
     memset(p, 0, sizeof(struct _ojParser));
     buf_init(&p->key);
     buf_init(&p->buf);
-    p->map = value_map;
+    p->map       = value_map;
+    p->use_mmap  = false;
+    p->read_size = DEFAULT_READ_SIZE;
 
     if (argc < 1) {
         oj_set_parser_validator(p);
@@ -1227,7 +1536,7 @@ static VALUE parser_new(int argc, VALUE *argv, VALUE self) {
                 mode = rb_sym2str(mode);
                 // fall through
             case RUBY_T_STRING: ms = RSTRING_PTR(mode); break;
-            default: rb_raise(rb_eArgError, "mode must be :validate, :usual, :saj, or :object");
+            default: rb_raise(rb_eArgError, "mode must be :validate, :usual, :saj, :lazy, :project, :schema, or :object");
             }
             if (0 == strcmp("usual", ms) || 0 == strcmp("standard", ms) || 0 == strcmp("strict", ms) ||
                 0 == strcmp("compat", ms)) {
@@ -1236,12 +1545,18 @@ static VALUE parser_new(int argc, VALUE *argv, VALUE self) {
                 // TBD
             } else if (0 == strcmp("saj", ms)) {
                 oj_set_parser_saj(p);
+            } else if (0 == strcmp("lazy", ms)) {
+                oj_set_parser_lazy(p);
+            } else if (0 == strcmp("project", ms)) {
+                oj_set_parser_project(p);
+            } else if (0 == strcmp("schema", ms)) {
+                oj_set_parser_schema(p);
             } else if (0 == strcmp("validate", ms)) {
                 oj_set_parser_validator(p);
             } else if (0 == strcmp("debug", ms)) {
                 oj_set_parser_debug(p);
             } else {
-                rb_raise(rb_eArgError, "mode must be :validate, :usual, :saj, or :object");
+                rb_raise(rb_eArgError, "mode must be :validate, :usual, :saj, :lazy, :project, :schema, or :object");
             }
         }
         if (1 < argc) {
@@ -1251,7 +1566,7 @@ static VALUE parser_new(int argc, VALUE *argv, VALUE self) {
             rb_hash_foreach(ropts, opt_cb, (VALUE)p);
         }
     }
-    return Data_Wrap_Struct(parser_class, parser_mark, parser_free, p);
+    return TypedData_Wrap_Struct(parser_class, &oj_parser_type, p);
 }
 
 /* Document-method: method_missing(value)
@@ -1281,6 +1596,11 @@ static VALUE parser_new(int argc, VALUE *argv, VALUE self) {
  *   - _cache_expunge=_ sets the value of the _cache_expunge_ where 0 never expunges, 1 expunges slowly, 2 expunges
  * faster, and 3 or higher expunges agressively.
  *   - _cache_expunge_ returns the value of the _cache_expunge_ integer value.
+ *   - _cache_shapes=_ sets the value of the _cache_shapes_ flag. When set, and keys are cached, the keys of recently seen
+ * objects with the same sequence of keys are reused without a key cache lookup.
+ *   - _cache_shapes_ returns the value of the _cache_shapes_ flag.
+ *   - _cache_stats_ returns a Hash of the size, count, hits, misses, rehashes, expunged entries, retired tables,
+ * permanent entries, and bytes held for each of the delegate's caches.
  *   - _capacity=_ sets the capacity of the parser. The parser grows automatically but can be updated directly with this
  * call.
  *   - _capacity_ returns the current capacity of the parser's internal stack.
@@ -1302,8 +1622,21 @@ static VALUE parser_new(int argc, VALUE *argv, VALUE self) {
  *   - _omit_null=_ sets the _omit_null_ flag. If true then null values in a map or object are omitted from the
  * resulting Hash or Object.
  *   - _omit_null_ returns the value of the _omit_null_ flag.
+ *   - _register_keys_ adds an Array of keys to the key cache as permanent entries. Keys are registered in the Symbol
+ * cache if _symbol_keys_ is set and in the String cache otherwise so set _symbol_keys_ first.
  *   - _symbol_keys=_ sets the flag that indicates Hash keys should be parsed to Symbols versus Strings.
  *   - _symbol_keys_ returns the value of the _symbol_keys_ flag.
+ *
+ * - *:project*
+ *   - _paths=_ sets the paths, such as "user.id" or "items[*].sku", of the values to return.
+ *   - _paths_ returns the paths.
+ *
+ * - *:schema*
+ *   - _schema=_ sets the Struct or Data class of the top level object.
+ *   - _schema_ returns the schema class.
+ *   - _types=_ sets a Hash of class to a Hash of member to the Struct or Data class of the member or to an Array of
+ * that class for an array of them.
+ *   - _types_ returns the types Hash.
  */
 static VALUE parser_missing(int argc, VALUE *argv, VALUE self) {
     ojParser       p    = (ojParser)DATA_PTR(self);
@@ -1328,41 +1661,210 @@ static VALUE parser_missing(int argc, VALUE *argv, VALUE self) {
     return p->option(p, key, rv);
 }
 
-/* Document-method: parse(json)
- * call-seq: parse(json)
+struct _source {
+    ojParser    p;
+    VALUE       src;
+    const byte *json;
+    size_t      len;
+    ojTape        tape;
+    bool          ok;
+    volatile bool stop;
+};
+
+static void *scan_source(void *x) {
+    struct _source *s = (struct _source *)x;
+
+    s->ok = oj_tape_scan(s->tape, s->json, s->len);
+
+    return NULL;
+}
+
+// Called by Ruby to interrupt the scan.
+static void stop_scan(void *x) {
+    *(volatile bool *)x = true;
+}
+
+static VALUE scan_replay_source(VALUE x) {
+    struct _source *s = (struct _source *)x;
+
+    // A stopped scan is started over if none of the pending interrupts raised.
+    while (true) {
+        s->stop = false;
+        rb_thread_call_without_gvl(scan_source, s, stop_scan, (void *)&s->stop);
+        if (s->ok || !s->stop) {
+            break;
+        }
+        rb_thread_check_ints();
+    }
+    if (!s->ok) {
+        rb_raise(oj_json_parser_error_class, "%s at %ld:%ld", s->tape->p.err, s->tape->p.line, s->tape->p.col);
+    }
+    oj_tape_replay(s->tape, s->p, 1, NULL, NULL);
+
+    return Qnil;
+}
+
+static VALUE return_tape(VALUE x) {
+    struct _source *s = (struct _source *)x;
+
+    s->tape->stop = NULL;
+    if (NULL == s->p->tape) {
+        s->p->tape = s->tape;
+    } else {
+        oj_tape_cleanup(s->tape);
+        xfree(s->tape);
+    }
+    return Qnil;
+}
+
+// The scan onto the tape makes no Ruby calls so other threads can run while
+// it is made. Only the replay through the delegate needs the GVL. The tape is
+// taken from the parser while in use so a parser shared by mistake can not
+// scan into the same tape from two threads. The scan is in the ensured
+// function too since an interrupt raises as soon as the GVL is taken back.
+static void parse_released(struct _source *s) {
+    ojParser       p   = s->p;
+    volatile VALUE src = s->src;
+
+    if (T_STRING == rb_type(src)) {
+        // A frozen copy shares the bytes but they can not be changed by
+        // another thread while the GVL is released.
+        src     = rb_str_new_frozen(src);
+        s->json = (const byte *)RSTRING_PTR(src);
+    }
+    if (NULL == (s->tape = p->tape)) {
+        s->tape = ALLOC(struct _ojTape);
+        oj_tape_init(s->tape);
+    }
+    p->tape             = NULL;
+    s->tape->p.just_one = p->just_one;
+    s->tape->stop       = &s->stop;
+    rb_ensure(scan_replay_source, (VALUE)s, return_tape, (VALUE)s);
+    RB_GC_GUARD(src);
+}
+
+static VALUE parse_source(VALUE x) {
+    struct _source *s = (struct _source *)x;
+
+    if (!s->p->stop_one && 0 < s->p->release_gvl && s->p->release_gvl <= s->len) {
+        parse_released(s);
+    } else {
+        parse(s->p, s->json, s->len);
+    }
+    return Qnil;
+}
+
+#ifdef HAVE_RB_IO_BUFFER_GET_BYTES_FOR_READING
+static VALUE unlock_buffer(VALUE x) {
+    rb_io_buffer_unlock(((struct _source *)x)->src);
+
+    return Qnil;
+}
+#endif
+
+/* Document-method: parse(json, offset=nil, length=nil)
+ * call-seq: parse(json, offset=nil, length=nil)
+ *
+ * Parse a JSON string or IO::Buffer.
  *
- * Parse a JSON string.
+ * When an _offset_ is given only the bytes from _offset_ up to _offset_ +
+ * _length_ (or the end of _json_ if _length_ is not given) are parsed and
+ * parsing stops after the first JSON element. The bytes are not copied. The
+ * #consumed method then returns the number of bytes used, including any white
+ * space after the element, so a buffer holding many JSON documents back to
+ * back can be walked with
+ *
+ *   offset = 0
+ *   while offset < buf.bytesize
+ *     doc = p.parse(buf, offset)
+ *     offset += p.consumed
+ *   end
  *
  * Returns the result according to the delegate of the parser.
  */
-static VALUE parser_parse(VALUE self, VALUE json) {
-    ojParser p = (ojParser)DATA_PTR(self);
+static VALUE parser_parse(int argc, VALUE *argv, VALUE self) {
+    ojParser       p = (ojParser)DATA_PTR(self);
+    struct _source s;
+    size_t         offset = 0;
+
+    rb_check_arity(argc, 1, 3);
+    s.p   = p;
+    s.src = *argv;
+#ifdef HAVE_RB_IO_BUFFER_GET_BYTES_FOR_READING
+    if (rb_obj_is_kind_of(s.src, rb_cIOBuffer)) {
+        const void *base;
+
+        rb_io_buffer_get_bytes_for_reading(s.src, &base, &s.len);
+        s.json = (const byte *)base;
+    } else
+#endif
+    {
+        Check_Type(s.src, T_STRING);
+        s.json = (const byte *)RSTRING_PTR(s.src);
+        s.len  = RSTRING_LEN(s.src);
+    }
+    if (1 < argc) {
+        long off = NUM2LONG(argv[1]);
+        long len = (2 < argc && Qnil != argv[2]) ? NUM2LONG(argv[2]) : (long)s.len - off;
 
-    Check_Type(json, T_STRING);
+        if (off < 0 || len < 0 || s.len < (size_t)off + (size_t)len) {
+            rb_raise(rb_eArgError, "offset %ld and length %ld are outside of the %ld bytes of JSON", off, len, (long)s.len);
+        }
+        offset = (size_t)off;
+        s.len  = (size_t)len;
+    }
+    s.json += offset;
     parser_reset(p);
+    p->stop_one = (1 < argc);
+    p->consumed = s.len;
     p->start(p);
-    parse(p, (const byte *)rb_string_value_ptr(&json));
+#ifdef HAVE_RB_IO_BUFFER_GET_BYTES_FOR_READING
+    if (T_STRING != rb_type(s.src)) {
+        // Locked so a callback into Ruby can not free or resize the buffer
+        // while it is being parsed.
+        rb_io_buffer_lock(s.src);
+        rb_ensure(parse_source, (VALUE)&s, unlock_buffer, (VALUE)&s);
+
+        return p->result(p);
+    }
+#endif
+    parse_source((VALUE)&s);
 
     return p->result(p);
 }
 
+struct _read {
+    ojParser p;
+    VALUE    rbuf;
+};
+
+static VALUE read_chunk(VALUE x) {
+    struct _read *r = (struct _read *)x;
+
+    rb_funcall(r->p->reader, oj_readpartial_id, 2, ULONG2NUM(r->p->read_size), r->rbuf);
+
+    return Qtrue;
+}
+
 static VALUE load_rescue(VALUE self, VALUE x) {
     // Normal EOF. No action needed other than to stop loading.
     return Qfalse;
 }
 
-static VALUE load(VALUE self) {
-    ojParser       p    = (ojParser)DATA_PTR(self);
-    volatile VALUE rbuf = rb_str_new2("");
+// Only EOFError from readpartial ends the load. Anything raised by the
+// delegate, including an EOFError from a block, is passed on.
+static void load(ojParser p) {
+    struct _read r;
 
-    p->start(p);
-    while (true) {
-        rb_funcall(p->reader, oj_readpartial_id, 2, INT2NUM(16385), rbuf);
-        if (0 < RSTRING_LEN(rbuf)) {
-            parse(p, (byte *)StringValuePtr(rbuf));
+    r.p    = p;
+    r.rbuf = rb_str_new2("");
+    while (Qtrue == rb_rescue2(read_chunk, (VALUE)&r, load_rescue, Qnil, rb_eEOFError, 0)) {
+        if (0 < RSTRING_LEN(r.rbuf)) {
+            parse_chunk(p, (byte *)StringValuePtr(r.rbuf), RSTRING_LEN(r.rbuf), false);
         }
     }
-    return Qtrue;
+    RB_GC_GUARD(r.rbuf);
+    parse_chunk(p, (const byte *)"", 0, true);
 }
 
 /* Document-method: load(reader)
@@ -1377,61 +1879,311 @@ static VALUE parser_load(VALUE self, VALUE reader) {
 
     parser_reset(p);
     p->reader = reader;
-    rb_rescue2(load, self, load_rescue, Qnil, rb_eEOFError, 0);
+    p->start(p);
+    load(p);
 
     return p->result(p);
 }
 
+static void yield_doc(ojParser p) {
+    rb_yield(p->result(p));
+    p->start(p);
+}
+
+/* Document-method: each(source)
+ * call-seq: each(source) { |doc| }
+ *
+ * Parse a stream of JSON documents from a String or from an IO or any other
+ * object that responds to readpartial. Each top level document is yielded as
+ * soon as it is complete and the delegate is reset before the next one so
+ * memory use is bounded by the largest document and not the whole stream.
+ * The _just_one_ option is ignored.
+ *
+ * Returns self or an Enumerator if no block is given.
+ */
+static VALUE parser_each(VALUE self, VALUE source) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    RETURN_ENUMERATOR(self, 1, &source);
+    parser_reset(p);
+    p->start(p);
+    p->doc_done = yield_doc;
+    if (rb_respond_to(source, oj_readpartial_id)) {
+        p->reader = source;
+        load(p);
+    } else {
+        volatile VALUE src;
+
+        Check_Type(source, T_STRING);
+        // A frozen copy shares the bytes but can not be changed by the block.
+        src = rb_str_new_frozen(source);
+        parse(p, (const byte *)RSTRING_PTR(src), RSTRING_LEN(src));
+    }
+    p->doc_done = NULL;
+
+    return self;
+}
+
+/* Document-method: feed(json)
+ * call-seq: feed(json) { |doc| }
+ *
+ * Parse the next part of a JSON stream. The parser continues exactly where
+ * the last part ended so a document, string, or number may be split across
+ * any number of calls. If a block is given each top level document that is
+ * completed by the part is yielded and the delegate is reset for the next
+ * one. After a parse error or an exception from the block the next feed
+ * starts a new stream.
+ *
+ * Returns self.
+ */
+static VALUE parser_feed(VALUE self, VALUE json) {
+    ojParser       p = (ojParser)DATA_PTR(self);
+    volatile VALUE src;
+
+    Check_Type(json, T_STRING);
+    if (!p->feeding) {
+        parser_reset(p);
+        p->start(p);
+    }
+    p->feeding = false;
+    if (rb_block_given_p()) {
+        p->doc_done = yield_doc;
+        // A frozen copy shares the bytes but can not be changed by the block.
+        src = rb_str_new_frozen(json);
+    } else {
+        p->doc_done = NULL;
+        src         = json;
+    }
+    parse_chunk(p, (const byte *)RSTRING_PTR(src), RSTRING_LEN(src), false);
+    p->doc_done = NULL;
+    p->feeding  = true;
+
+    return self;
+}
+
+/* Document-method: finish
+ * call-seq: finish { |doc| }
+ *
+ * Ends a JSON stream started with #feed. An error is raised if the stream
+ * ends in the middle of a document. A number at the end of the stream is
+ * only complete once finish is called so it is yielded if a block is given.
+ *
+ * Returns the result according to the delegate of the parser.
+ */
+static VALUE parser_finish(VALUE self) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    if (!p->feeding) {
+        parser_reset(p);
+        p->start(p);
+    }
+    p->feeding  = false;
+    p->doc_done = rb_block_given_p() ? yield_doc : NULL;
+    parse_chunk(p, (const byte *)"", 0, true);
+    p->doc_done = NULL;
+
+    return p->result(p);
+}
+
+struct _file {
+    ojParser    p;
+    const char *path;
+    int         fd;
+    byte       *buf;
+    size_t      size;
+    bool        mapped;
+};
+
+static VALUE file_map(VALUE x) {
+    struct _file *f = (struct _file *)x;
+
+    parse(f->p, f->buf, f->size);
+
+    return Qnil;
+}
+
+static VALUE file_read(VALUE x) {
+    struct _file *f = (struct _file *)x;
+    ssize_t       rsize;
+
+    f->size = f->p->read_size;
+    f->buf  = ALLOC_N(byte, f->size);
+    while (true) {
+        if (0 < (rsize = read(f->fd, f->buf, f->size))) {
+            parse_chunk(f->p, f->buf, (size_t)rsize, false);
+        } else if (0 == rsize) {
+            parse_chunk(f->p, f->buf, 0, true);
+            break;
+        } else if (EINTR != errno) {
+            rb_raise(rb_eIOError, "error reading from %s", f->path);
+        }
+    }
+    return Qnil;
+}
+
+static VALUE file_close(VALUE x) {
+    struct _file *f = (struct _file *)x;
+
+#if !IS_WINDOWS
+    if (f->mapped) {
+        munmap(f->buf, f->size);
+    } else
+#endif
+    {
+        xfree(f->buf);
+    }
+    close(f->fd);
+
+    return Qnil;
+}
+
 /* Document-method: file(filename)
  * call-seq: file(filename)
  *
- * Parse a JSON file.
+ * Parse a JSON file. The file is read in chunks of read_size bytes. If the
+ * mmap option is true regular files are memory mapped instead.
  *
  * Returns the result according to the delegate of the parser.
  */
 static VALUE parser_file(VALUE self, VALUE filename) {
-    ojParser    p = (ojParser)DATA_PTR(self);
-    const char *path;
-    int         fd;
+    ojParser     p = (ojParser)DATA_PTR(self);
+    struct _file f;
 
     Check_Type(filename, T_STRING);
-    path = rb_string_value_ptr(&filename);
+    memset(&f, 0, sizeof(f));
+    f.p    = p;
+    f.path = rb_string_value_ptr(&filename);
 
     parser_reset(p);
     p->start(p);
 
-    if (0 > (fd = open(path, O_RDONLY))) {
-        rb_raise(rb_eIOError, "error opening %s", path);
-    }
-#if USE_THREAD_LIMIT
-    struct stat info;
-    // st_size will be 0 if not a file
-    if (0 == fstat(fd, &info) && USE_THREAD_LIMIT < info.st_size) {
-        // Use threaded version.
-        // TBD only if has pthreads
-        // TBD parse_large(p, fd);
-        return p->result(p);
+    if (0 > (f.fd = open(f.path, O_RDONLY))) {
+        rb_raise(rb_eIOError, "error opening %s", f.path);
     }
-#endif
-    byte   buf[16385];
-    size_t size = sizeof(buf) - 1;
-    size_t rsize;
-
-    while (true) {
-        if (0 < (rsize = read(fd, buf, size))) {
-            buf[rsize] = '\0';
-            parse(p, buf);
-        }
-        if (rsize <= 0) {
-            if (0 != rsize) {
-                rb_raise(rb_eIOError, "error reading from %s", path);
+#if !IS_WINDOWS
+    if (p->use_mmap) {
+        struct stat info;
+
+        if (0 == fstat(f.fd, &info) && S_ISREG(info.st_mode) && 0 < info.st_size &&
+            (uint64_t)info.st_size <= (uint64_t)SIZE_MAX) {
+            void *addr = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, f.fd, 0);
+
+            if (MAP_FAILED != addr) {
+                // The mapping is parsed front to back once so the kernel can
+                // read ahead aggressively and drop pages behind.
+                madvise(addr, (size_t)info.st_size, MADV_SEQUENTIAL);
+                f.buf    = (byte *)addr;
+                f.size   = (size_t)info.st_size;
+                f.mapped = true;
+                rb_ensure(file_map, (VALUE)&f, file_close, (VALUE)&f);
+
+                return p->result(p);
             }
-            break;
         }
     }
+#endif
+    rb_ensure(file_read, (VALUE)&f, file_close, (VALUE)&f);
+
     return p->result(p);
 }
 
+/* Document-method: consumed
+ * call-seq: consumed
+ *
+ * Returns the number of bytes used by the last call to #parse. After a range
+ * parse that is the length of the first JSON element plus any white space
+ * that follows it.
+ */
+static VALUE parser_consumed(VALUE self) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    return ULONG2NUM(p->consumed);
+}
+
+/* Document-method: file_lines(filename)
+ * call-seq: file_lines(filename) { |docs| }
+ *
+ * Parse a JSON Lines (NDJSON) file with one JSON document on each line. The
+ * file is split into chunks at line ends and the byte level scanning of each
+ * chunk is done on a separate thread without the GVL. Documents are then
+ * built in order on the calling thread. The number of scanning threads is
+ * set with the _threads_ option and defaults to one per processor. With a
+ * single scanning thread this is slower than parsing each line with #parse.
+ *
+ * If a block is given it is called with an Array of the results of the
+ * documents in each chunk, in order, and nil is returned. Otherwise an Array
+ * of the results of all the documents is returned. A document may not span
+ * more than one line.
+ */
+static VALUE parser_file_lines(VALUE self, VALUE filename) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    Check_Type(filename, T_STRING);
+    parser_reset(p);
+    p->start(p);
+
+    return oj_parser_file_lines(p, rb_string_value_ptr(&filename));
+}
+
+/* Document-method: threads
+ * call-seq: threads
+ *
+ * Returns the number of threads used by #file_lines, zero for one per
+ * processor.
+ */
+static VALUE parser_threads(VALUE self) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    return INT2NUM(p->threads);
+}
+
+/* Document-method: threads=
+ * call-seq: threads=(value)
+ *
+ * Sets the number of threads used by #file_lines to scan chunks of the file.
+ * Zero, the default, uses one per processor.
+ *
+ * Returns the number of threads.
+ */
+static VALUE parser_threads_set(VALUE self, VALUE v) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    p->threads = NUM2INT(v);
+
+    return INT2NUM(p->threads);
+}
+
+/* Document-method: release_gvl
+ * call-seq: release_gvl
+ *
+ * Returns the size in bytes of the smallest document #parse scans without
+ * holding the GVL, zero if never.
+ */
+static VALUE parser_release_gvl(VALUE self) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    return ULONG2NUM(p->release_gvl);
+}
+
+/* Document-method: release_gvl=
+ * call-seq: release_gvl=(size)
+ *
+ * Sets the size in bytes of the smallest document #parse scans without
+ * holding the GVL. The scan records the document on a tape that is then
+ * replayed through the delegate with the GVL held so other Ruby threads can
+ * run during the scan. Zero, the default, turns this off. Ranges are always
+ * parsed with the GVL held.
+ *
+ * Returns the size.
+ */
+static VALUE parser_release_gvl_set(VALUE self, VALUE v) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    p->release_gvl = NUM2ULONG(v);
+
+    return ULONG2NUM(p->release_gvl);
+}
+
 /* Document-method: just_one
  * call-seq: just_one
  *
@@ -1459,6 +2211,61 @@ static VALUE parser_just_one_set(VALUE self, VALUE v) {
     return p->just_one ? Qtrue : Qfalse;
 }
 
+/* Document-method: mmap
+ * call-seq: mmap
+ *
+ * Returns true if #file memory maps regular files.
+ */
+static VALUE parser_mmap(VALUE self) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    return p->use_mmap ? Qtrue : Qfalse;
+}
+
+/* Document-method: mmap=
+ * call-seq: mmap=(value)
+ *
+ * Sets the *mmap* option. When true #file memory maps regular files and
+ * parses the whole mapping in one pass. When false, the default, files are
+ * read in chunks of read_size bytes.
+ *
+ * Returns the current state of the mmap [_Boolean_] option.
+ */
+static VALUE parser_mmap_set(VALUE self, VALUE v) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    p->use_mmap = (Qtrue == v);
+
+    return p->use_mmap ? Qtrue : Qfalse;
+}
+
+/* Document-method: read_size
+ * call-seq: read_size
+ *
+ * Returns the number of bytes read at a time by #file and #load.
+ */
+static VALUE parser_read_size(VALUE self) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    return ULONG2NUM(p->read_size);
+}
+
+/* Document-method: read_size=
+ * call-seq: read_size=(value)
+ *
+ * Sets the number of bytes read at a time by #file for pipes, FIFOs, and
+ * files that are not memory mapped, and by #load. The default is 65536.
+ *
+ * Returns the read size.
+ */
+static VALUE parser_read_size_set(VALUE self, VALUE v) {
+    ojParser p = (ojParser)DATA_PTR(self);
+
+    read_size_set(p, v);
+
+    return ULONG2NUM(p->read_size);
+}
+
 static VALUE usual_parser = Qundef;
 
 /* Document-method: usual
@@ -1474,9 +2281,11 @@ static VALUE parser_usual(VALUE self) {
         memset(p, 0, sizeof(struct _ojParser));
         buf_init(&p->key);
         buf_init(&p->buf);
-        p->map = value_map;
+        p->map       = value_map;
+        p->use_mmap  = false;
+        p->read_size = DEFAULT_READ_SIZE;
         oj_set_parser_usual(p);
-        usual_parser = Data_Wrap_Struct(parser_class, parser_mark, parser_free, p);
+        usual_parser = TypedData_Wrap_Struct(parser_class, &oj_parser_type, p);
         rb_gc_register_address(&usual_parser);
     }
     return usual_parser;
@@ -1497,9 +2306,11 @@ static VALUE parser_saj(VALUE self) {
         memset(p, 0, sizeof(struct _ojParser));
         buf_init(&p->key);
         buf_init(&p->buf);
-        p->map = value_map;
+        p->map       = value_map;
+        p->use_mmap  = false;
+        p->read_size = DEFAULT_READ_SIZE;
         oj_set_parser_saj(p);
-        saj_parser = Data_Wrap_Struct(parser_class, parser_mark, parser_free, p);
+        saj_parser = TypedData_Wrap_Struct(parser_class, &oj_parser_type, p);
         rb_gc_register_address(&saj_parser);
     }
     return saj_parser;
@@ -1519,9 +2330,11 @@ static VALUE parser_validate(VALUE self) {
         memset(p, 0, sizeof(struct _ojParser));
         buf_init(&p->key);
         buf_init(&p->buf);
-        p->map = value_map;
+        p->map       = value_map;
+        p->use_mmap  = false;
+        p->read_size = DEFAULT_READ_SIZE;
         oj_set_parser_validator(p);
-        validate_parser = Data_Wrap_Struct(parser_class, parser_mark, parser_free, p);
+        validate_parser = TypedData_Wrap_Struct(parser_class, &oj_parser_type, p);
         rb_gc_register_address(&validate_parser);
     }
     return validate_parser;
@@ -1539,16 +2352,39 @@ static VALUE parser_validate(VALUE self) {
  * forced to use the same options.
  */
 void oj_parser_init(void) {
+#if OJ_X86_SIMD
+    if (oj_cpu_avx512()) {
+        scan_str_func = scan_str_avx512;
+    } else if (oj_cpu_avx2()) {
+        scan_str_func = scan_str_avx2;
+    } else {
+        scan_str_func = scan_str_sse2;
+    }
+#endif
     parser_class = rb_define_class_under(Oj, "Parser", rb_cObject);
     rb_gc_register_address(&parser_class);
     rb_undef_alloc_func(parser_class);
+    oj_lazy_init(parser_class);
 
     rb_define_module_function(parser_class, "new", parser_new, -1);
-    rb_define_method(parser_class, "parse", parser_parse, 1);
+    rb_define_method(parser_class, "parse", parser_parse, -1);
     rb_define_method(parser_class, "load", parser_load, 1);
+    rb_define_method(parser_class, "each", parser_each, 1);
+    rb_define_method(parser_class, "feed", parser_feed, 1);
+    rb_define_method(parser_class, "finish", parser_finish, 0);
     rb_define_method(parser_class, "file", parser_file, 1);
+    rb_define_method(parser_class, "file_lines", parser_file_lines, 1);
+    rb_define_method(parser_class, "consumed", parser_consumed, 0);
     rb_define_method(parser_class, "just_one", parser_just_one, 0);
     rb_define_method(parser_class, "just_one=", parser_just_one_set, 1);
+    rb_define_method(parser_class, "mmap", parser_mmap, 0);
+    rb_define_method(parser_class, "mmap=", parser_mmap_set, 1);
+    rb_define_method(parser_class, "read_size", parser_read_size, 0);
+    rb_define_method(parser_class, "read_size=", parser_read_size_set, 1);
+    rb_define_method(parser_class, "release_gvl", parser_release_gvl, 0);
+    rb_define_method(parser_class, "release_gvl=", parser_release_gvl_set, 1);
+    rb_define_method(parser_class, "threads", parser_threads, 0);
+    rb_define_method(parser_class, "threads=", parser_threads_set, 1);
     rb_define_method(parser_class, "method_missing", parser_missing, -1);
 
     rb_define_module_function(parser_class, "usual", parser_usual, 0);
@@ -4,17 +4,104 @@
 #ifndef OJ_PARSER_H
 #define OJ_PARSER_H
 
+#include <setjmp.h>
 #include <stdbool.h>
 #include <ruby.h>
 
 #include "buf.h"
+#include "ruby/encoding.h"
 
 #define TOP_FUN 0
 #define ARRAY_FUN 1
 #define OBJECT_FUN 2
 
+// 9,223,372,036,854,775,807
+#define BIG_LIMIT (LLONG_MAX / 10)
+#define FRAC_LIMIT 10000000000000000ULL
+#define MAX_EXP 4932
+
+// Maximum depth of nested arrays and objects.
+#define MAX_DEPTH 1023
+
+// Limits on the fixnum for adding eight more digits without overflow.
+#define DIGITS8_LIMIT ((LLONG_MAX - 99999999LL) / 100000000LL)
+#define FRAC8_LIMIT (FRAC_LIMIT / 100000000ULL)
+
 typedef uint8_t byte;
 
+// Eight digits are loaded as one little endian word, checked, and converted
+// with three multiplies instead of eight multiply and adds.
+inline static uint64_t oj_load8(const byte *b) {
+    uint64_t v;
+
+    memcpy(&v, b, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+inline static bool oj_is_8digits(uint64_t v) {
+    return 0x3333333333333333ULL ==
+           ((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4));
+}
+
+inline static uint64_t oj_8digits(uint64_t v) {
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+         (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >>
+        32;
+
+    return v;
+}
+
+// The coderange of a parsed string. A string starts as CR_7BIT and moves to
+// CR_VALID when a multibyte sequence is added. The byte maps only check the
+// number of continuation bytes so the lead and first continuation byte are
+// checked here for overlong forms, surrogates, and code points past
+// 0x10FFFF. Those are accepted by the parser but are left for Ruby to sort
+// out with CR_UNKNOWN.
+#define CR_7BIT 0
+#define CR_VALID 1
+#define CR_UNKNOWN 2
+
+inline static char oj_utf8_cr(char cr, byte lead, byte next) {
+    bool ok;
+
+    switch (lead) {
+    case 0xE0: ok = (0xA0 <= next); break;
+    case 0xED: ok = (next <= 0x9F); break;
+    case 0xF0: ok = (0x90 <= next); break;
+    case 0xF4: ok = (next <= 0x8F); break;
+    default: ok = (0xC2 <= lead && lead <= 0xF4); break;
+    }
+    if (!ok) {
+        return CR_UNKNOWN;
+    }
+    return (cr < CR_VALID) ? CR_VALID : cr;
+}
+
+inline static char oj_ucode_cr(char cr, uint32_t code) {
+    if (code < 0x80) {
+        return cr;
+    }
+    if ((0xD800 <= code && code <= 0xDFFF) || 0x10FFFF < code) {
+        return CR_UNKNOWN;
+    }
+    return (cr < CR_VALID) ? CR_VALID : cr;
+}
+
+// Marks a new String with a known coderange so Ruby does not scan it again.
+inline static VALUE oj_str_cr(VALUE str, char cr) {
+    switch (cr) {
+    case CR_7BIT: ENC_CODERANGE_SET(str, ENC_CODERANGE_7BIT); break;
+    case CR_VALID: ENC_CODERANGE_SET(str, ENC_CODERANGE_VALID); break;
+    default: break;
+    }
+    return str;
+}
+
 typedef enum {
     OJ_NONE    = '\0',
     OJ_NULL    = 'n',
@@ -34,7 +121,7 @@ typedef struct _num {
     uint32_t    len;
     int16_t     div;  // 10^div
     int16_t     exp;
-    uint8_t     shift;  // shift of fixnum to get decimal
+    uint16_t    shift;  // shift of fixnum to get decimal
     bool        neg;
     bool        exp_neg;
     // for numbers as strings, reuse buf
@@ -66,6 +153,8 @@ typedef struct _ojParser {
     struct _num num;
     struct _buf key;
     struct _buf buf;
+    char        key_cr;  // coderange of key
+    char        buf_cr;  // coderange of a string in buf
 
     struct _funcs funcs[3]; // indexed by XXX_FUN defines
 
@@ -74,18 +163,49 @@ typedef struct _ojParser {
     VALUE (*result)(struct _ojParser *p);
     void (*free)(struct _ojParser *p);
     void (*mark)(struct _ojParser *p);
+    void (*compact)(struct _ojParser *p);  // NULL if nothing can move
 
     void *ctx;
     VALUE reader;
 
+    // Regular files are memory mapped by file() if use_mmap is true.
+    // Everything else is read read_size bytes at a time.
+    bool   use_mmap;
+    size_t read_size;
+
+    int threads;  // used by file_lines, zero for one per processor
+
+    // Documents of release_gvl bytes or more are scanned onto the tape
+    // without the GVL and then replayed through the delegate. Zero turns
+    // that off.
+    size_t          release_gvl;
+    struct _ojTape *tape;
+
+    // When set doc_done is called after each top level value is complete.
+    void (*doc_done)(struct _ojParser *p);
+
+    // When set parse errors jump back to err_jump with the message in err
+    // instead of raising so a parser with C only delegate functions can be
+    // used without the GVL.
+    jmp_buf *err_jump;
+    char     err[256];
+
     char     token[8];
     long     line;
     long     cur;  // only set before call to a function
     long     col;
     int      ri;
     uint32_t ucode;
+    byte     lead;  // lead byte of a multibyte sequence until the next byte
     ojType   type;  // valType
     bool     just_one;
+    bool     stop_one;  // stop after the first value, set for range parses
+    bool     feeding;   // between the first feed and finish
+    size_t   consumed;  // bytes used by the last call to parse
 } * ojParser;
 
+extern void oj_parser_scan(ojParser p, const byte *json, size_t len);
+
+extern VALUE oj_parser_file_lines(ojParser p, const char *path);
+
 #endif /* OJ_PARSER_H */
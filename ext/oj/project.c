@@ -0,0 +1,596 @@
+// Copyright (c) 2026 the Oj contributors. All rights reserved.
+// Licensed under the MIT License. See LICENSE file in the project root for license details.
+
+#include "oj.h"
+#include "parser.h"
+
+// The Project delegate only builds the values at a set of paths such as
+// "user.id" or "items[*].sku". The paths are compiled into a trie of path
+// segments. For each depth of the document the nodes of the trie that can
+// still match are kept as the active nodes of that level. A member of an
+// array or object is only looked at if one of the active nodes has a child
+// that matches the key or index of the member. Everything else is stepped
+// over without creating any Ruby objects. The result is a Hash of path to
+// value. A path with a wildcard collects all the values it matches in an
+// Array.
+
+#define KEY 'k'
+#define INDEX 'i'
+#define ANY_KEY 'K'
+#define ANY_INDEX 'I'
+
+typedef struct _node {
+    char * key;
+    size_t klen;
+    long   index;
+    int    child;  // first child or -1
+    int    next;   // next sibling or -1
+    int    path;   // index of the path that ends at this node or -1
+    char   kind;
+} * Node;
+
+typedef struct _level {
+    int   start;      // offset of the active nodes in active
+    int   cnt;        // number of active nodes
+    long  index;      // of the next element when an array
+    VALUE container;  // Qundef unless the level is being built
+} * Level;
+
+typedef struct _delegate {
+    Node          nodes;  // the root is nodes[0]
+    int           ncnt;
+    int           ncap;
+    int *         active;
+    int           acnt;  // number of matches on top of the current level
+    int           acap;
+    bool          term;  // true if one of the matches is the end of a path
+    bool *        multi;
+    VALUE         paths;
+    VALUE         result;
+    struct _level levels[MAX_DEPTH + 1];
+} * Delegate;
+
+static void reserve_active(Delegate d, int cnt) {
+    if (d->acap < cnt) {
+        d->acap = cnt * 2;
+        REALLOC_N(d->active, int, d->acap);
+    }
+}
+
+// Finds the children of the active nodes of the level that match the member
+// and puts them on top of the active nodes of the level. Returns false if
+// the member is not part of any path.
+static bool match(Delegate d, Level lev, const char *key, size_t klen) {
+    int  top   = lev->start + lev->cnt;
+    long index = lev->index++;
+    int *ap;
+    int *end;
+
+    d->acnt = 0;
+    d->term = false;
+    for (ap = d->active + lev->start, end = ap + lev->cnt; ap < end; ap++) {
+        int c;
+
+        for (c = d->nodes[*ap].child; 0 <= c; c = d->nodes[c].next) {
+            Node n = d->nodes + c;
+
+            switch (n->kind) {
+            case KEY:
+                if (NULL == key || n->klen != klen || 0 != memcmp(n->key, key, klen)) {
+                    continue;
+                }
+                break;
+            case INDEX:
+                if (NULL != key || n->index != index) {
+                    continue;
+                }
+                break;
+            case ANY_KEY:
+                if (NULL == key) {
+                    continue;
+                }
+                break;
+            case ANY_INDEX:
+                if (NULL != key) {
+                    continue;
+                }
+                break;
+            }
+            // The active array may be moved so ap must be reset.
+            if (d->acap <= top + d->acnt) {
+                int off = (int)(ap - d->active);
+
+                reserve_active(d, top + d->acnt + 1);
+                ap  = d->active + off;
+                end = d->active + lev->start + lev->cnt;
+            }
+            d->active[top + d->acnt] = c;
+            d->acnt++;
+            if (0 <= n->path) {
+                d->term = true;
+            }
+        }
+    }
+    return Qundef != lev->container || 0 < d->acnt;
+}
+
+static void store(Delegate d, int path, VALUE v) {
+    VALUE key = RARRAY_AREF(d->paths, path);
+
+    if (Qundef == d->result) {
+        d->result = rb_hash_new();
+    }
+    if (d->multi[path]) {
+        volatile VALUE a = rb_hash_lookup2(d->result, key, Qundef);
+
+        if (Qundef == a) {
+            a = rb_ary_new();
+            rb_hash_aset(d->result, key, a);
+        }
+        rb_ary_push(a, v);
+    } else {
+        rb_hash_aset(d->result, key, v);
+    }
+}
+
+// Adds the value to the container being built and to the result for each
+// path that ends with the member.
+static void place(Delegate d, Level lev, const char *key, size_t klen, VALUE v) {
+    if (Qundef != lev->container) {
+        if (NULL == key) {
+            rb_ary_push(lev->container, v);
+        } else {
+            rb_hash_aset(lev->container, rb_str_freeze(rb_utf8_str_new(key, klen)), v);
+        }
+    }
+    if (d->term) {
+        int *ap  = d->active + lev->start + lev->cnt;
+        int *end = ap + d->acnt;
+
+        for (; ap < end; ap++) {
+            if (0 <= d->nodes[*ap].path) {
+                store(d, d->nodes[*ap].path, v);
+            }
+        }
+    }
+}
+
+static void add_leaf(ojParser p, const char *key, size_t klen, VALUE (*make)(ojParser p)) {
+    Delegate d   = (Delegate)p->ctx;
+    Level    lev = d->levels + p->depth;
+
+    if (match(d, lev, key, klen)) {
+        place(d, lev, key, klen, make(p));
+    }
+}
+
+static void open_container(ojParser p, const char *key, size_t klen, bool array) {
+    Delegate d    = (Delegate)p->ctx;
+    Level    lev  = d->levels + p->depth;
+    Level    next = lev + 1;
+    int *    ap;
+    int *    end;
+    int *    kp;
+
+    next->start     = lev->start + lev->cnt;
+    next->cnt       = 0;
+    next->index     = 0;
+    next->container = Qundef;
+    if (0 == p->depth) {
+        // The paths start with the members of the top level array or object.
+        reserve_active(d, 1);
+        d->active[0] = 0;
+        next->cnt    = 1;
+        return;
+    }
+    if (!match(d, lev, key, klen)) {
+        return;
+    }
+    if (Qundef != lev->container || d->term) {
+        next->container = array ? rb_ary_new() : rb_hash_new();
+        place(d, lev, key, klen, next->container);
+    }
+    // Only the matches that lead to deeper paths stay active.
+    for (ap = kp = d->active + next->start, end = ap + d->acnt; ap < end; ap++) {
+        if (0 <= d->nodes[*ap].child) {
+            *kp++ = *ap;
+        }
+    }
+    next->cnt = (int)(kp - (d->active + next->start));
+}
+
+static VALUE null_value(ojParser p) {
+    return Qnil;
+}
+
+static VALUE true_value(ojParser p) {
+    return Qtrue;
+}
+
+static VALUE false_value(ojParser p) {
+    return Qfalse;
+}
+
+static VALUE int_value(ojParser p) {
+    return LONG2NUM(p->num.fixnum);
+}
+
+static VALUE float_value(ojParser p) {
+    return rb_float_new((double)p->num.dub);
+}
+
+static VALUE big_value(ojParser p) {
+    return rb_funcall(rb_cObject, oj_bigdecimal_id, 1, rb_str_new(buf_str(&p->buf), buf_len(&p->buf)));
+}
+
+static VALUE str_value(ojParser p) {
+    return oj_str_cr(rb_utf8_str_new(buf_str(&p->buf), buf_len(&p->buf)), p->buf_cr);
+}
+
+static void add_null(ojParser p) {
+    add_leaf(p, NULL, 0, null_value);
+}
+
+static void add_null_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), null_value);
+}
+
+static void add_true(ojParser p) {
+    add_leaf(p, NULL, 0, true_value);
+}
+
+static void add_true_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), true_value);
+}
+
+static void add_false(ojParser p) {
+    add_leaf(p, NULL, 0, false_value);
+}
+
+static void add_false_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), false_value);
+}
+
+static void add_int(ojParser p) {
+    add_leaf(p, NULL, 0, int_value);
+}
+
+static void add_int_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), int_value);
+}
+
+static void add_float(ojParser p) {
+    add_leaf(p, NULL, 0, float_value);
+}
+
+static void add_float_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), float_value);
+}
+
+static void add_big(ojParser p) {
+    add_leaf(p, NULL, 0, big_value);
+}
+
+static void add_big_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), big_value);
+}
+
+static void add_str(ojParser p) {
+    add_leaf(p, NULL, 0, str_value);
+}
+
+static void add_str_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), str_value);
+}
+
+static void open_object(ojParser p) {
+    open_container(p, NULL, 0, false);
+}
+
+static void open_object_key(ojParser p) {
+    open_container(p, buf_str(&p->key), buf_len(&p->key), false);
+}
+
+static void open_array(ojParser p) {
+    open_container(p, NULL, 0, true);
+}
+
+static void open_array_key(ojParser p) {
+    open_container(p, buf_str(&p->key), buf_len(&p->key), true);
+}
+
+// Nothing to do on a close since the levels are indexed by the depth.
+static void close_container(ojParser p) {
+}
+
+static int add_node(Delegate d, int parent, char kind, const char *key, size_t klen, long index) {
+    Node n;
+    int  c;
+
+    for (c = d->nodes[parent].child; 0 <= c; c = d->nodes[c].next) {
+        n = d->nodes + c;
+        if (n->kind == kind && n->index == index && n->klen == klen &&
+            (0 == klen || 0 == memcmp(n->key, key, klen))) {
+            return c;
+        }
+    }
+    if (d->ncap <= d->ncnt) {
+        d->ncap *= 2;
+        REALLOC_N(d->nodes, struct _node, d->ncap);
+    }
+    c        = d->ncnt++;
+    n        = d->nodes + c;
+    n->kind  = kind;
+    n->klen  = klen;
+    n->index = index;
+    n->child = -1;
+    n->path  = -1;
+    n->next  = d->nodes[parent].child;
+    n->key   = NULL;
+    if (0 < klen) {
+        n->key = ALLOC_N(char, klen);
+        memcpy(n->key, key, klen);
+    }
+    d->nodes[parent].child = c;
+
+    return c;
+}
+
+static void clear_nodes(Delegate d) {
+    int i;
+
+    for (i = 0; i < d->ncnt; i++) {
+        xfree(d->nodes[i].key);
+    }
+    d->ncnt           = 1;
+    d->nodes[0].child = -1;
+    d->nodes[0].next  = -1;
+    d->nodes[0].path  = -1;
+    d->nodes[0].key   = NULL;
+    d->nodes[0].klen  = 0;
+    d->nodes[0].index = 0;
+    d->nodes[0].kind  = KEY;
+}
+
+static void bad_path(VALUE path) {
+    rb_raise(rb_eArgError, "'%s' is not a valid path", StringValueCStr(path));
+}
+
+// A path is a series of keys separated by a '.' with array indices in
+// brackets such as "items[2].sku". A '*' as a key or index matches any key
+// or index.
+static void compile_path(Delegate d, VALUE path, int pi) {
+    const char *start = RSTRING_PTR(path);
+    const char *end   = start + RSTRING_LEN(path);
+    const char *s     = start;
+    int         n     = 0;
+
+    d->multi[pi] = false;
+    while (s < end) {
+        if ('[' == *s) {
+            s++;
+            if (s < end && '*' == *s) {
+                s++;
+                n            = add_node(d, n, ANY_INDEX, NULL, 0, 0);
+                d->multi[pi] = true;
+            } else {
+                const char *digits = s;
+                long        index  = 0;
+
+                for (; s < end && '0' <= *s && *s <= '9'; s++) {
+                    index = index * 10 + (long)(*s - '0');
+                }
+                if (digits == s) {
+                    bad_path(path);
+                }
+                n = add_node(d, n, INDEX, NULL, 0, index);
+            }
+            if (end <= s || ']' != *s) {
+                bad_path(path);
+            }
+            s++;
+        } else {
+            const char *key = s;
+
+            if (0 < n) {
+                if ('.' != *s) {
+                    bad_path(path);
+                }
+                key = ++s;
+            }
+            for (; s < end && '.' != *s && '[' != *s; s++) {
+            }
+            if (key == s) {
+                bad_path(path);
+            }
+            if (1 == s - key && '*' == *key) {
+                n            = add_node(d, n, ANY_KEY, NULL, 0, 0);
+                d->multi[pi] = true;
+            } else {
+                n = add_node(d, n, KEY, key, s - key, 0);
+            }
+        }
+    }
+    if (0 == n) {
+        bad_path(path);
+    }
+    d->nodes[n].path = pi;
+}
+
+static VALUE opt_paths(ojParser p, VALUE value) {
+    Delegate d = (Delegate)p->ctx;
+
+    return rb_ary_dup(d->paths);
+}
+
+static VALUE compile_paths(VALUE arg) {
+    Delegate d   = (Delegate)arg;
+    long     cnt = RARRAY_LEN(d->paths);
+    long     i;
+
+    for (i = 0; i < cnt; i++) {
+        compile_path(d, RARRAY_AREF(d->paths, i), (int)i);
+    }
+    return Qnil;
+}
+
+// The paths are compiled into a new set of nodes. The nodes, paths, and
+// multi flags of the delegate are only replaced once every path compiles so
+// a bad path leaves the delegate as it was.
+static VALUE opt_paths_set(ojParser p, VALUE value) {
+    Delegate       d = (Delegate)p->ctx;
+    volatile VALUE paths;
+    volatile VALUE old_paths = d->paths;
+    Node           old_nodes = d->nodes;
+    int            old_ncnt  = d->ncnt;
+    int            old_ncap  = d->ncap;
+    bool *         old_multi = d->multi;
+    long           cnt;
+    long           i;
+    int            err = 0;
+
+    Check_Type(value, T_ARRAY);
+    cnt   = RARRAY_LEN(value);
+    paths = rb_ary_new_capa(cnt);
+    for (i = 0; i < cnt; i++) {
+        VALUE path = RARRAY_AREF(value, i);
+
+        if (RUBY_T_SYMBOL == rb_type(path)) {
+            path = rb_sym2str(path);
+        }
+        Check_Type(path, T_STRING);
+        rb_ary_push(paths, rb_str_freeze(rb_str_dup(path)));
+    }
+    rb_ary_freeze(paths);
+    d->ncap  = 16;
+    d->ncnt  = 0;
+    d->nodes = ALLOC_N(struct _node, d->ncap);
+    d->multi = ALLOC_N(bool, cnt + 1);
+    d->paths = paths;
+    clear_nodes(d);
+    rb_protect(compile_paths, (VALUE)d, &err);
+    if (0 != err) {
+        clear_nodes(d);
+        xfree(d->nodes);
+        xfree(d->multi);
+        d->nodes = old_nodes;
+        d->ncnt  = old_ncnt;
+        d->ncap  = old_ncap;
+        d->multi = old_multi;
+        d->paths = old_paths;
+        rb_jump_tag(err);
+    }
+    for (i = 0; i < old_ncnt; i++) {
+        xfree(old_nodes[i].key);
+    }
+    xfree(old_nodes);
+    xfree(old_multi);
+
+    return opt_paths(p, value);
+}
+
+static VALUE option(ojParser p, const char *key, VALUE value) {
+    if (0 == strcmp(key, "paths")) {
+        return opt_paths(p, value);
+    }
+    if (0 == strcmp(key, "paths=")) {
+        return opt_paths_set(p, value);
+    }
+    rb_raise(rb_eArgError, "%s is not an option for the Project delegate", key);
+
+    return Qnil;  // Never reached due to the raise but required by the compiler.
+}
+
+static VALUE result(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+
+    if (Qundef == d->result) {
+        d->result = rb_hash_new();
+    }
+    return d->result;
+}
+
+static void start(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+
+    d->result              = Qundef;
+    d->levels[0].start     = 0;
+    d->levels[0].cnt       = 0;
+    d->levels[0].index     = 0;
+    d->levels[0].container = Qundef;
+}
+
+static void dfree(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+
+    clear_nodes(d);
+    xfree(d->nodes);
+    xfree(d->active);
+    xfree(d->multi);
+    xfree(d);
+}
+
+static void mark(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+
+    if (NULL == d) {
+        return;
+    }
+    rb_gc_mark(d->paths);
+    if (Qundef != d->result) {
+        rb_gc_mark(d->result);
+    }
+}
+
+void oj_set_parser_project(ojParser p) {
+    Delegate d = ALLOC(struct _delegate);
+    Funcs    f = &p->funcs[TOP_FUN];
+
+    d->ncap   = 16;
+    d->nodes  = ALLOC_N(struct _node, d->ncap);
+    d->ncnt   = 0;
+    d->acap   = 64;
+    d->active = ALLOC_N(int, d->acap);
+    d->acnt   = 0;
+    d->term   = false;
+    d->multi  = ALLOC_N(bool, 1);
+    d->paths  = rb_ary_freeze(rb_ary_new());
+    d->result = Qundef;
+    clear_nodes(d);
+
+    p->ctx = (void *)d;
+    start(p);
+
+    f->add_null     = add_null;
+    f->add_true     = add_true;
+    f->add_false    = add_false;
+    f->add_int      = add_int;
+    f->add_float    = add_float;
+    f->add_big      = add_big;
+    f->add_str      = add_str;
+    f->open_array   = open_array;
+    f->close_array  = close_container;
+    f->open_object  = open_object;
+    f->close_object = close_container;
+
+    p->funcs[ARRAY_FUN] = *f;
+
+    f               = &p->funcs[OBJECT_FUN];
+    f->add_null     = add_null_key;
+    f->add_true     = add_true_key;
+    f->add_false    = add_false_key;
+    f->add_int      = add_int_key;
+    f->add_float    = add_float_key;
+    f->add_big      = add_big_key;
+    f->add_str      = add_str_key;
+    f->open_array   = open_array_key;
+    f->close_array  = close_container;
+    f->open_object  = open_object_key;
+    f->close_object = close_container;
+
+    p->option = option;
+    p->result = result;
+    p->free   = dfree;
+    p->mark   = mark;
+    p->start  = start;
+}
@@ -580,6 +580,14 @@ static void mark(ojParser p) {
     }
 }
 
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+static void compact(ojParser p) {
+    if (NULL != p->ctx) {
+        cache_compact(((Delegate)p->ctx)->str_cache);
+    }
+}
+#endif
+
 static VALUE form_str(const char *str, size_t len) {
     return rb_str_freeze(rb_utf8_str_new(str, len));
 }
@@ -599,4 +607,7 @@ void oj_set_parser_saj(ojParser p) {
     p->free   = dfree;
     p->mark   = mark;
     p->start  = start;
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+    p->compact = compact;
+#endif
 }
@@ -0,0 +1,592 @@
+// Copyright (c) 2026 the Oj contributors. All rights reserved.
+// Licensed under the MIT License. See LICENSE file in the project root for license details.
+
+#include "oj.h"
+#include "parser.h"
+
+// The Schema delegate parses directly into instances of Struct or Data
+// classes. The schema is a class and the types of its members, which can be
+// other Struct or Data classes or arrays of them. Each class is compiled
+// into a shape with a perfect hash table of member name to position so a
+// key is matched with a single compare. Member values are collected in
+// position order and the instance is created with all of them at once when
+// the JSON object closes. Keys that are not members are stepped over
+// without creating any Ruby objects.
+
+#define SHAPE_FRAME 'S'  // an instance of a shape
+#define LIST_FRAME 'L'   // an array of instances of a shape
+#define HASH_FRAME 'h'
+#define ARRAY_FRAME 'a'
+#define SKIP_FRAME 'x'
+
+struct _shape;
+
+typedef struct _field {
+    char *         key;
+    size_t         klen;
+    struct _shape *shape;  // NULL if the value is not typed
+    bool           list;   // true for an array of shape
+} * Field;
+
+typedef struct _shape {
+    VALUE          clas;
+    int            cnt;
+    uint32_t       seed;
+    uint32_t       mask;
+    int *          table;  // mask + 1 entries of field index or -1
+    Field          fields;
+    struct _shape *next;
+} * Shape;
+
+typedef struct _frame {
+    Shape shape;
+    VALUE container;
+    VALUE key;   // key in the parent when the parent is a Hash
+    int   slot;  // position in the parent when the parent is a shape
+    char  kind;
+} * Frame;
+
+typedef struct _delegate {
+    VALUE         schema;
+    VALUE         types;
+    Shape         shapes;
+    Shape         root;
+    VALUE         result;
+    ID            members_id;
+    struct _frame frames[MAX_DEPTH + 1];
+} * Delegate;
+
+static uint32_t key_hash(const char *key, size_t len, uint32_t seed) {
+    uint32_t    h   = 2166136261U ^ seed;
+    const char *end = key + len;
+
+    for (; key < end; key++) {
+        h ^= (uint8_t)*key;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static int lookup(Shape s, const char *key, size_t len) {
+    int i = s->table[key_hash(key, len, s->seed) & s->mask];
+
+    if (0 <= i && s->fields[i].klen == len && 0 == memcmp(s->fields[i].key, key, len)) {
+        return i;
+    }
+    return -1;
+}
+
+// Looks for a seed that puts each member in a different slot. The table is
+// doubled if no seed is found in a reasonable number of tries.
+static void build_table(Shape s) {
+    uint32_t size = 4;
+
+    while (size < (uint32_t)s->cnt * 2) {
+        size *= 2;
+    }
+    while (true) {
+        uint32_t seed;
+
+        REALLOC_N(s->table, int, size);
+        s->mask = size - 1;
+        for (seed = 0; seed < 256; seed++) {
+            int i;
+
+            memset(s->table, -1, sizeof(int) * size);
+            for (i = 0; i < s->cnt; i++) {
+                int *slot = s->table + (key_hash(s->fields[i].key, s->fields[i].klen, seed) & s->mask);
+
+                if (0 <= *slot) {
+                    break;
+                }
+                *slot = i;
+            }
+            if (s->cnt <= i) {
+                s->seed = seed;
+                return;
+            }
+        }
+        size *= 2;
+    }
+}
+
+static void free_shapes(Delegate d) {
+    Shape s;
+
+    while (NULL != (s = d->shapes)) {
+        int i;
+
+        d->shapes = s->next;
+        for (i = 0; i < s->cnt; i++) {
+            xfree(s->fields[i].key);
+        }
+        xfree(s->fields);
+        xfree(s->table);
+        xfree(s);
+    }
+    d->root = NULL;
+}
+
+static Shape find_shape(Delegate d, VALUE clas);
+
+static void set_field_type(Delegate d, Shape s, VALUE member, VALUE type) {
+    Field f;
+    int   i;
+
+    if (RUBY_T_SYMBOL == rb_type(member)) {
+        member = rb_sym2str(member);
+    }
+    Check_Type(member, T_STRING);
+    if (0 > (i = lookup(s, RSTRING_PTR(member), RSTRING_LEN(member)))) {
+        rb_raise(rb_eArgError, "%s is not a member of %s", RSTRING_PTR(member), rb_class2name(s->clas));
+    }
+    f = s->fields + i;
+    if (RUBY_T_ARRAY == rb_type(type) && 1 == RARRAY_LEN(type)) {
+        f->list = true;
+        type    = RARRAY_AREF(type, 0);
+    }
+    f->shape = find_shape(d, type);
+}
+
+// Shapes are shared by class so a class can be a member type of itself.
+static Shape find_shape(Delegate d, VALUE clas) {
+    Shape          s;
+    volatile VALUE members;
+    volatile VALUE types;
+    int            i;
+
+    for (s = d->shapes; NULL != s; s = s->next) {
+        if (clas == s->clas) {
+            return s;
+        }
+    }
+    if (RUBY_T_CLASS != rb_type(clas) || !rb_respond_to(clas, d->members_id)) {
+        rb_raise(rb_eArgError, "schema types must be Struct or Data classes");
+    }
+    if (rb_respond_to(clas, rb_intern("keyword_init?")) && RTEST(rb_funcall(clas, rb_intern("keyword_init?"), 0))) {
+        rb_raise(rb_eArgError, "keyword_init Structs are not supported by the schema delegate");
+    }
+    members = rb_funcall(clas, d->members_id, 0);
+    Check_Type(members, T_ARRAY);
+
+    s         = ALLOC(struct _shape);
+    s->clas   = clas;
+    s->cnt    = (int)RARRAY_LEN(members);
+    s->table  = NULL;
+    s->fields = ALLOC_N(struct _field, s->cnt);
+    s->next   = d->shapes;
+    d->shapes = s;
+    for (i = 0; i < s->cnt; i++) {
+        VALUE name = rb_sym2str(RARRAY_AREF(members, i));
+        Field f    = s->fields + i;
+
+        f->klen  = RSTRING_LEN(name);
+        f->key   = ALLOC_N(char, f->klen + 1);
+        f->shape = NULL;
+        f->list  = false;
+        memcpy(f->key, RSTRING_PTR(name), f->klen);
+        f->key[f->klen] = '\0';
+    }
+    build_table(s);
+
+    if (Qnil != d->types && Qnil != (types = rb_hash_lookup(d->types, clas))) {
+        long cnt;
+
+        Check_Type(types, T_HASH);
+        members = rb_funcall(types, rb_intern("to_a"), 0);
+        cnt     = RARRAY_LEN(members);
+        for (i = 0; i < cnt; i++) {
+            VALUE pair = RARRAY_AREF(members, i);
+
+            set_field_type(d, s, RARRAY_AREF(pair, 0), RARRAY_AREF(pair, 1));
+        }
+    }
+    return s;
+}
+
+struct _compile {
+    Delegate d;
+    VALUE    schema;
+};
+
+static VALUE compile_root(VALUE arg) {
+    struct _compile *c = (struct _compile *)arg;
+
+    c->d->root = find_shape(c->d, c->schema);
+
+    return Qnil;
+}
+
+// The new shapes are built apart from the current ones which are only
+// replaced, along with the schema and types, if every class compiles. A
+// rejected value leaves the delegate as it was. The old schema and types
+// are held until then so the classes of the old shapes stay marked.
+static void compile(Delegate d, VALUE schema, VALUE types) {
+    volatile VALUE old_schema = d->schema;
+    volatile VALUE old_types  = d->types;
+    Shape          old_shapes = d->shapes;
+    Shape          old_root   = d->root;
+    Shape          shapes;
+    Shape          root;
+    int            err = 0;
+
+    d->shapes = NULL;
+    d->root   = NULL;
+    d->types  = types;
+    if (Qnil != schema) {
+        struct _compile c = {d, schema};
+
+        rb_protect(compile_root, (VALUE)&c, &err);
+    }
+    if (0 != err) {
+        free_shapes(d);
+        d->shapes = old_shapes;
+        d->root   = old_root;
+        d->types  = old_types;
+        rb_jump_tag(err);
+    }
+    shapes    = d->shapes;
+    root      = d->root;
+    d->shapes = old_shapes;
+    free_shapes(d);
+    d->shapes = shapes;
+    d->root   = root;
+    d->schema = schema;
+    RB_GC_GUARD(old_schema);
+    RB_GC_GUARD(old_types);
+}
+
+static VALUE big_value(ojParser p) {
+    return rb_funcall(rb_cObject, oj_bigdecimal_id, 1, rb_str_new(buf_str(&p->buf), buf_len(&p->buf)));
+}
+
+static VALUE str_value(ojParser p) {
+    return oj_str_cr(rb_utf8_str_new(buf_str(&p->buf), buf_len(&p->buf)), p->buf_cr);
+}
+
+// Finds the frame a member belongs to and the position of the member. A
+// NULL return means the member is to be skipped.
+static Frame member(ojParser p, const char *key, size_t klen, int *slot) {
+    Delegate d = (Delegate)p->ctx;
+    Frame    f = d->frames + p->depth;
+
+    if (0 == p->depth) {
+        return f;
+    }
+    switch (f->kind) {
+    case SHAPE_FRAME:
+        if (0 > (*slot = lookup(f->shape, key, klen))) {
+            return NULL;
+        }
+        break;
+    case SKIP_FRAME: return NULL;
+    default: break;
+    }
+    return f;
+}
+
+static void add(ojParser p, Frame f, const char *key, size_t klen, int slot, VALUE v) {
+    Delegate d = (Delegate)p->ctx;
+
+    if (0 == p->depth) {
+        d->result = v;
+        return;
+    }
+    switch (f->kind) {
+    case SHAPE_FRAME: rb_ary_store(f->container, slot, v); break;
+    case HASH_FRAME: rb_hash_aset(f->container, rb_str_freeze(rb_utf8_str_new(key, klen)), v); break;
+    default: rb_ary_push(f->container, v); break;
+    }
+}
+
+static void add_leaf(ojParser p, const char *key, size_t klen, VALUE v) {
+    int   slot = 0;
+    Frame f    = member(p, key, klen, &slot);
+
+    if (NULL != f) {
+        add(p, f, key, klen, slot, v);
+    }
+}
+
+static void add_null(ojParser p) {
+    add_leaf(p, NULL, 0, Qnil);
+}
+
+static void add_null_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), Qnil);
+}
+
+static void add_true(ojParser p) {
+    add_leaf(p, NULL, 0, Qtrue);
+}
+
+static void add_true_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), Qtrue);
+}
+
+static void add_false(ojParser p) {
+    add_leaf(p, NULL, 0, Qfalse);
+}
+
+static void add_false_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), Qfalse);
+}
+
+static void add_int(ojParser p) {
+    add_leaf(p, NULL, 0, LONG2NUM(p->num.fixnum));
+}
+
+static void add_int_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), LONG2NUM(p->num.fixnum));
+}
+
+static void add_float(ojParser p) {
+    add_leaf(p, NULL, 0, rb_float_new((double)p->num.dub));
+}
+
+static void add_float_key(ojParser p) {
+    add_leaf(p, buf_str(&p->key), buf_len(&p->key), rb_float_new((double)p->num.dub));
+}
+
+// Strings and big numbers are only created for members that are kept.
+static void add_made(ojParser p, const char *key, size_t klen, VALUE (*make)(ojParser p)) {
+    int   slot = 0;
+    Frame f    = member(p, key, klen, &slot);
+
+    if (NULL != f) {
+        add(p, f, key, klen, slot, make(p));
+    }
+}
+
+static void add_big(ojParser p) {
+    add_made(p, NULL, 0, big_value);
+}
+
+static void add_big_key(ojParser p) {
+    add_made(p, buf_str(&p->key), buf_len(&p->key), big_value);
+}
+
+static void add_str(ojParser p) {
+    add_made(p, NULL, 0, str_value);
+}
+
+static void add_str_key(ojParser p) {
+    add_made(p, buf_str(&p->key), buf_len(&p->key), str_value);
+}
+
+static void open_container(ojParser p, const char *key, size_t klen, bool array) {
+    Delegate d     = (Delegate)p->ctx;
+    int      slot  = 0;
+    Frame    f     = member(p, key, klen, &slot);
+    Frame    next  = d->frames + p->depth + 1;
+    Shape    shape = NULL;
+    bool     list  = false;
+
+    next->slot      = slot;
+    next->key       = Qnil;
+    next->container = Qnil;
+    next->shape     = NULL;
+    if (NULL == f) {
+        next->kind = SKIP_FRAME;
+        return;
+    }
+    if (0 == p->depth) {
+        // A top level array is taken to be a list of the schema class.
+        shape = d->root;
+        list  = array;
+    } else {
+        switch (f->kind) {
+        case SHAPE_FRAME:
+            shape = f->shape->fields[slot].shape;
+            list  = f->shape->fields[slot].list;
+            break;
+        case LIST_FRAME: shape = f->shape; break;
+        case HASH_FRAME: next->key = rb_str_freeze(rb_utf8_str_new(key, klen)); break;
+        default: break;
+        }
+    }
+    // A value that does not fit the type is built as a plain Array or Hash.
+    if (NULL == shape || list != array) {
+        next->kind      = array ? ARRAY_FRAME : HASH_FRAME;
+        next->container = array ? rb_ary_new() : rb_hash_new();
+    } else if (array) {
+        next->kind      = LIST_FRAME;
+        next->shape     = shape;
+        next->container = rb_ary_new();
+    } else {
+        next->kind      = SHAPE_FRAME;
+        next->shape     = shape;
+        next->container = rb_ary_new_capa(shape->cnt);
+    }
+}
+
+static void open_object(ojParser p) {
+    open_container(p, NULL, 0, false);
+}
+
+static void open_object_key(ojParser p) {
+    open_container(p, buf_str(&p->key), buf_len(&p->key), false);
+}
+
+static void open_array(ojParser p) {
+    open_container(p, NULL, 0, true);
+}
+
+static void open_array_key(ojParser p) {
+    open_container(p, buf_str(&p->key), buf_len(&p->key), true);
+}
+
+// Called after the depth is reduced so the closed frame is one above.
+static void close_container(ojParser p) {
+    Delegate       d = (Delegate)p->ctx;
+    Frame          f = d->frames + p->depth + 1;
+    Frame          parent;
+    volatile VALUE v;
+
+    switch (f->kind) {
+    case SKIP_FRAME: return;
+    case SHAPE_FRAME: {
+        volatile VALUE slots = f->container;
+        long           cnt   = RARRAY_LEN(slots);
+
+        // Members that were not in the JSON are nil.
+        for (; cnt < f->shape->cnt; cnt++) {
+            rb_ary_push(slots, Qnil);
+        }
+        v = rb_funcallv(f->shape->clas, oj_new_id, f->shape->cnt, RARRAY_CONST_PTR(slots));
+        break;
+    }
+    default: v = f->container; break;
+    }
+    f->container = Qnil;
+    if (0 == p->depth) {
+        d->result = v;
+        return;
+    }
+    parent = d->frames + p->depth;
+    switch (parent->kind) {
+    case SHAPE_FRAME: rb_ary_store(parent->container, f->slot, v); break;
+    case HASH_FRAME: rb_hash_aset(parent->container, f->key, v); break;
+    default: rb_ary_push(parent->container, v); break;
+    }
+    f->key = Qnil;
+}
+
+static VALUE option(ojParser p, const char *key, VALUE value) {
+    Delegate d = (Delegate)p->ctx;
+
+    if (0 == strcmp(key, "schema")) {
+        return d->schema;
+    }
+    if (0 == strcmp(key, "schema=")) {
+        compile(d, value, d->types);
+        return d->schema;
+    }
+    if (0 == strcmp(key, "types")) {
+        return d->types;
+    }
+    if (0 == strcmp(key, "types=")) {
+        if (Qnil != value) {
+            Check_Type(value, T_HASH);
+        }
+        compile(d, d->schema, value);
+        return d->types;
+    }
+    rb_raise(rb_eArgError, "%s is not an option for the Schema delegate", key);
+
+    return Qnil;  // Never reached due to the raise but required by the compiler.
+}
+
+static VALUE result(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+
+    return d->result;
+}
+
+static void start(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+
+    d->result = Qnil;
+}
+
+static void dfree(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+
+    free_shapes(d);
+    xfree(d);
+}
+
+static void mark(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+    Shape    s;
+    int      i;
+
+    if (NULL == d) {
+        return;
+    }
+    rb_gc_mark(d->schema);
+    rb_gc_mark(d->types);
+    rb_gc_mark(d->result);
+    for (s = d->shapes; NULL != s; s = s->next) {
+        rb_gc_mark(s->clas);
+    }
+    // The frame above the depth is included since a frame is filled in
+    // before the depth is increased and is still used by close_container()
+    // after the depth is reduced. It is cleared once closed.
+    for (i = 1; i <= p->depth + 1 && i <= MAX_DEPTH; i++) {
+        rb_gc_mark(d->frames[i].container);
+        rb_gc_mark(d->frames[i].key);
+    }
+}
+
+void oj_set_parser_schema(ojParser p) {
+    Delegate d = ALLOC(struct _delegate);
+    Funcs    f = &p->funcs[TOP_FUN];
+    int      i;
+
+    d->schema     = Qnil;
+    d->types      = Qnil;
+    d->shapes     = NULL;
+    d->root       = NULL;
+    d->result     = Qnil;
+    d->members_id = rb_intern("members");
+    for (i = 0; i <= MAX_DEPTH; i++) {
+        d->frames[i].container = Qnil;
+        d->frames[i].key       = Qnil;
+        d->frames[i].kind      = SKIP_FRAME;
+    }
+    p->ctx = (void *)d;
+
+    f->add_null     = add_null;
+    f->add_true     = add_true;
+    f->add_false    = add_false;
+    f->add_int      = add_int;
+    f->add_float    = add_float;
+    f->add_big      = add_big;
+    f->add_str      = add_str;
+    f->open_array   = open_array;
+    f->close_array  = close_container;
+    f->open_object  = open_object;
+    f->close_object = close_container;
+
+    p->funcs[ARRAY_FUN] = *f;
+
+    f               = &p->funcs[OBJECT_FUN];
+    f->add_null     = add_null_key;
+    f->add_true     = add_true_key;
+    f->add_false    = add_false_key;
+    f->add_int      = add_int_key;
+    f->add_float    = add_float_key;
+    f->add_big      = add_big_key;
+    f->add_str      = add_str_key;
+    f->open_array   = open_array_key;
+    f->close_array  = close_container;
+    f->open_object  = open_object_key;
+    f->close_object = close_container;
+
+    p->option = option;
+    p->result = result;
+    p->free   = dfree;
+    p->mark   = mark;
+    p->start  = start;
+}
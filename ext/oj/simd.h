@@ -0,0 +1,36 @@
+// Copyright (c) 2026 the Oj contributors. All rights reserved.
+// Licensed under the MIT License. See LICENSE file in the project root for license details.
+
+#ifndef OJ_SIMD_H
+#define OJ_SIMD_H
+
+#include <stdbool.h>
+
+// SIMD support is selected at run time so the extension can be built once
+// and still take advantage of wider instructions when the CPU has them. SSE2
+// is always available on x86-64 so it is the baseline. The wider versions are
+// compiled with a target attribute and only called if the CPU reports
+// support. Building with --without-simd defines OJ_NO_SIMD and leaves only
+// the byte map versions.
+
+#if !defined(OJ_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define OJ_X86_SIMD 1
+#include <immintrin.h>
+
+#define OJ_TARGET_AVX2 __attribute__((target("avx2,bmi")))
+#define OJ_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,bmi")))
+
+inline static bool oj_cpu_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+inline static bool oj_cpu_avx512(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512bw");
+}
+#else
+#define OJ_X86_SIMD 0
+#endif
+
+#endif /* OJ_SIMD_H */
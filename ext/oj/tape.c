@@ -0,0 +1,334 @@
+// Copyright (c) 2026 the Oj contributors. All rights reserved.
+// Licensed under the MIT License. See LICENSE file in the project root for license details.
+
+#include "tape.h"
+
+#include <stdlib.h>
+
+#define OPS_START 4096
+#define STRS_START 65536
+
+// Only malloc is used while scanning since the scan may be on a thread that
+// is not known to Ruby. That includes the key and string buffers of the scan
+// parser. Without err_jump the scan is on a Ruby thread.
+static void no_memory(ojParser p) {
+    if (NULL == p->err_jump) {
+        rb_raise(rb_eNoMemError, "failed to grow the tape");
+    }
+    strcpy(p->err, "out of memory");
+    longjmp(*p->err_jump, 1);
+}
+
+static ojOp push_op(ojParser p, char type) {
+    ojTape t = (ojTape)p->ctx;
+    ojOp   op;
+
+    // Checked here since this is called for every value and key.
+    if (NULL != t->stop && *t->stop && NULL != p->err_jump) {
+        strcpy(p->err, "interrupted");
+        longjmp(*p->err_jump, 1);
+    }
+    if (t->end <= t->tail) {
+        size_t cnt  = t->end - t->head;
+        size_t size = (0 == cnt) ? OPS_START : cnt * 2;
+        ojOp   head;
+
+        if (NULL == (head = (ojOp)realloc(t->head, sizeof(struct _ojOp) * size))) {
+            no_memory(p);
+        }
+        t->head = head;
+        t->tail = head + cnt;
+        t->end  = head + size;
+    }
+    op       = t->tail++;
+    op->type = type;
+    op->line = (uint32_t)p->line;
+    op->col  = (uint32_t)(p->cur - p->col);
+    op->len  = 0;
+    switch (type) {
+    case 'k': break;
+    case '}':
+    case ']':
+        // Called after the depth is reduced.
+        t->head[t->opens[p->depth]].v.off = op - t->head;
+        break;
+    case '{':
+    case '[':
+        t->opens[p->depth] = op - t->head;
+        // fall through
+    default:
+        if (0 < p->depth) {
+            t->head[t->opens[p->depth - 1]].len++;
+        }
+        break;
+    }
+    return op;
+}
+
+static size_t push_bytes(ojParser p, const void *bytes, size_t len) {
+    ojTape t   = (ojTape)p->ctx;
+    size_t off = t->strs_len;
+
+    if (t->strs_cap < t->strs_len + len) {
+        size_t cap = (0 == t->strs_cap) ? STRS_START : t->strs_cap * 2;
+        char * strs;
+
+        for (; cap < t->strs_len + len; cap *= 2) {
+        }
+        if (NULL == (strs = (char *)realloc(t->strs, cap))) {
+            no_memory(p);
+        }
+        t->strs     = strs;
+        t->strs_cap = cap;
+    }
+    memcpy(t->strs + off, bytes, len);
+    t->strs_len += len;
+
+    return off;
+}
+
+static void push_str(ojParser p, char type, Buf buf) {
+    size_t len = buf_len(buf);
+    ojOp   op;
+
+    if (UINT32_MAX < len) {
+        if (NULL == p->err_jump) {
+            rb_raise(rb_eRangeError, "string of %lu bytes is too long", (unsigned long)len);
+        }
+        snprintf(p->err, sizeof(p->err), "string of %lu bytes is too long", (unsigned long)len);
+        longjmp(*p->err_jump, 1);
+    }
+    op        = push_op(p, type);
+    op->len   = (uint32_t)len;
+    op->cr    = (&p->key == buf) ? p->key_cr : p->buf_cr;
+    op->v.off = push_bytes(p, buf->head, len);
+}
+
+static void add_null(ojParser p) {
+    push_op(p, 'n');
+}
+
+static void add_null_key(ojParser p) {
+    push_str(p, 'k', &p->key);
+    push_op(p, 'n');
+}
+
+static void add_true(ojParser p) {
+    push_op(p, 't');
+}
+
+static void add_true_key(ojParser p) {
+    push_str(p, 'k', &p->key);
+    push_op(p, 't');
+}
+
+static void add_false(ojParser p) {
+    push_op(p, 'f');
+}
+
+static void add_false_key(ojParser p) {
+    push_str(p, 'k', &p->key);
+    push_op(p, 'f');
+}
+
+static void add_int(ojParser p) {
+    push_op(p, 'i')->v.fixnum = p->num.fixnum;
+}
+
+static void add_int_key(ojParser p) {
+    push_str(p, 'k', &p->key);
+    add_int(p);
+}
+
+// The long double is kept so the replay sees exactly what the parser would
+// have passed to the delegate.
+static void add_float(ojParser p) {
+    ojOp op = push_op(p, 'd');
+
+    op->v.off = push_bytes(p, &p->num.dub, sizeof(p->num.dub));
+}
+
+static void add_float_key(ojParser p) {
+    push_str(p, 'k', &p->key);
+    add_float(p);
+}
+
+static void add_big(ojParser p) {
+    push_str(p, 'b', &p->buf);
+}
+
+static void add_big_key(ojParser p) {
+    push_str(p, 'k', &p->key);
+    push_str(p, 'b', &p->buf);
+}
+
+static void add_str(ojParser p) {
+    push_str(p, 's', &p->buf);
+}
+
+static void add_str_key(ojParser p) {
+    push_str(p, 'k', &p->key);
+    push_str(p, 's', &p->buf);
+}
+
+static void open_object(ojParser p) {
+    push_op(p, '{');
+}
+
+static void open_object_key(ojParser p) {
+    push_str(p, 'k', &p->key);
+    push_op(p, '{');
+}
+
+static void close_object(ojParser p) {
+    push_op(p, '}');
+}
+
+static void open_array(ojParser p) {
+    push_op(p, '[');
+}
+
+static void open_array_key(ojParser p) {
+    push_str(p, 'k', &p->key);
+    push_op(p, '[');
+}
+
+static void close_array(ojParser p) {
+    push_op(p, ']');
+}
+
+// The ctx of the parser must be the tape.
+void oj_tape_set_funcs(ojParser p) {
+    Funcs f = &p->funcs[TOP_FUN];
+
+    f->add_null     = add_null;
+    f->add_true     = add_true;
+    f->add_false    = add_false;
+    f->add_int      = add_int;
+    f->add_float    = add_float;
+    f->add_big      = add_big;
+    f->add_str      = add_str;
+    f->open_array   = open_array;
+    f->close_array  = close_array;
+    f->open_object  = open_object;
+    f->close_object = close_object;
+
+    p->funcs[ARRAY_FUN] = *f;
+
+    f               = &p->funcs[OBJECT_FUN];
+    f->add_null     = add_null_key;
+    f->add_true     = add_true_key;
+    f->add_false    = add_false_key;
+    f->add_int      = add_int_key;
+    f->add_float    = add_float_key;
+    f->add_big      = add_big_key;
+    f->add_str      = add_str_key;
+    f->open_array   = open_array_key;
+    f->close_array  = close_array;
+    f->open_object  = open_object_key;
+    f->close_object = close_object;
+}
+
+void oj_tape_init(ojTape t) {
+    memset(t, 0, sizeof(struct _ojTape));
+    buf_init_malloc(&t->p.key, &t->p.err_jump);
+    buf_init_malloc(&t->p.buf, &t->p.err_jump);
+    t->p.ctx = t;
+    oj_tape_set_funcs(&t->p);
+}
+
+void oj_tape_cleanup(ojTape t) {
+    buf_cleanup(&t->p.key);
+    buf_cleanup(&t->p.buf);
+    free(t->head);
+    free(t->strs);
+}
+
+// Returns false if the JSON is not valid or memory runs out. The message is
+// then in t->p.err and the location in t->p.line and t->p.col. No Ruby calls
+// are made.
+bool oj_tape_scan(ojTape t, const byte *json, size_t len) {
+    jmp_buf jump;
+
+    t->tail       = t->head;
+    t->strs_len   = 0;
+    t->p.err_jump = &jump;
+    *t->p.err     = '\0';
+    if (0 != setjmp(jump)) {
+        t->p.err_jump = NULL;
+        // Only a buffer that failed to grow jumps without a message.
+        if ('\0' == *t->p.err) {
+            strcpy(t->p.err, "out of memory");
+        }
+        return false;
+    }
+    oj_parser_scan(&t->p, json, len);
+    t->p.err_jump = NULL;
+
+    return true;
+}
+
+static void set_str(Buf buf, const char *str, size_t len) {
+    buf->tail = buf->head;
+    buf_append_string(buf, str, len);
+}
+
+// Makes the same calls on the delegate of p that the parser made while
+// scanning. The line is that of the start of the scanned JSON. If doc_done
+// is not NULL it is called after each top level value.
+void oj_tape_replay(ojTape t, ojParser p, long line, void (*doc_done)(ojParser p, void *ctx), void *ctx) {
+    ojOp op;
+
+    p->col = 0;
+    for (op = t->head; op < t->tail; op++) {
+        p->line = line + (long)op->line - 1;
+        p->cur  = (long)op->col;
+        switch (op->type) {
+        case 'n': p->funcs[p->stack[p->depth]].add_null(p); break;
+        case 't': p->funcs[p->stack[p->depth]].add_true(p); break;
+        case 'f': p->funcs[p->stack[p->depth]].add_false(p); break;
+        case 'i':
+            p->num.fixnum = op->v.fixnum;
+            p->funcs[p->stack[p->depth]].add_int(p);
+            break;
+        case 'd':
+            memcpy(&p->num.dub, t->strs + op->v.off, sizeof(p->num.dub));
+            p->funcs[p->stack[p->depth]].add_float(p);
+            break;
+        case 'b':
+            set_str(&p->buf, t->strs + op->v.off, op->len);
+            p->funcs[p->stack[p->depth]].add_big(p);
+            break;
+        case 's':
+            set_str(&p->buf, t->strs + op->v.off, op->len);
+            p->buf_cr = op->cr;
+            p->funcs[p->stack[p->depth]].add_str(p);
+            break;
+        case 'k':
+            set_str(&p->key, t->strs + op->v.off, op->len);
+            p->key_cr = op->cr;
+            continue;
+        case '{':
+            p->funcs[p->stack[p->depth]].open_object(p);
+            p->depth++;
+            p->stack[p->depth] = OBJECT_FUN;
+            continue;
+        case '[':
+            p->funcs[p->stack[p->depth]].open_array(p);
+            p->depth++;
+            p->stack[p->depth] = ARRAY_FUN;
+            continue;
+        case '}':
+            p->depth--;
+            p->funcs[p->stack[p->depth]].close_object(p);
+            break;
+        case ']':
+            p->depth--;
+            p->funcs[p->stack[p->depth]].close_array(p);
+            break;
+        }
+        if (0 == p->depth && NULL != doc_done) {
+            doc_done(p, ctx);
+        }
+    }
+}
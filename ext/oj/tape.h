@@ -0,0 +1,45 @@
+// Copyright (c) 2026 the Oj contributors. All rights reserved.
+// Licensed under the MIT License. See LICENSE file in the project root for license details.
+
+#ifndef OJ_TAPE_H
+#define OJ_TAPE_H
+
+#include "parser.h"
+
+// A tape is a flat record of the calls the parser makes to a delegate. The
+// tape delegate makes no Ruby calls so a scan can be made on any thread
+// without the GVL. The tape is then replayed through a real delegate on a
+// Ruby thread. An open op ({ or [) also has the number of members in len
+// and the index of the matching close op in v.off so a reader of the tape
+// can step over a whole array or object.
+typedef struct _ojOp {
+    uint32_t line;  // relative to the start of the scan
+    uint32_t col;
+    union {
+        int64_t fixnum;
+        size_t  off;  // offset of string, big number, or long double in strs
+    } v;
+    uint32_t len;
+    char     type;  // n t f i d b s k { } [ ]
+    char     cr;    // coderange of a string
+} * ojOp;
+
+typedef struct _ojTape {
+    struct _ojParser p;  // only used for the scan
+    ojOp             head;
+    ojOp             end;
+    ojOp             tail;
+    char *           strs;
+    size_t           strs_len;
+    size_t           strs_cap;
+    size_t           opens[MAX_DEPTH + 1];  // index of the open op at each depth
+    volatile bool   *stop;                  // the scan is abandoned once *stop is true
+} * ojTape;
+
+extern void oj_tape_init(ojTape t);
+extern void oj_tape_set_funcs(ojParser p);
+extern void oj_tape_cleanup(ojTape t);
+extern bool oj_tape_scan(ojTape t, const byte *json, size_t len);
+extern void oj_tape_replay(ojTape t, ojParser p, long line, void (*doc_done)(ojParser p, void *ctx), void *ctx);
+
+#endif /* OJ_TAPE_H */
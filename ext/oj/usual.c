@@ -39,14 +39,54 @@ typedef struct _col {
 typedef union _key {
     struct {
         int16_t len;
-        char    buf[30];
+        char    cr;
+        char    buf[29];
     };
     struct {
         int16_t xlen;  // should be the same as len
+        char    xcr;   // should be the same as cr
+        bool    heap;  // key was allocated on the heap instead of the arena
         char *  key;
     };
 } * Key;
 
+// A shape is the sequence of keys of a JSON object. Arrays of records
+// repeat the same shape over and over so the key VALUEs of recently seen
+// shapes are kept and reused instead of looking up each key in the key
+// cache. The shape table is direct mapped on the hash of the key sequence.
+#define SHAPE_CNT 64
+#define SHAPE_MAX_KEYS 64
+
+typedef struct _shape {
+    uint64_t hash;
+    int      cnt;
+    size_t   blen;
+    char *   bytes;  // length and bytes of each key
+    VALUE *  keys;
+} * Shape;
+
+// Keys too long for the key buf are copied into an arena of blocks instead
+// of each being allocated and freed. The arena is rewound whenever the key
+// stack is empty and blocks past the first are released at the start of
+// each parse. Once ARENA_MAX bytes are in use keys are allocated on the
+// heap again.
+#define ARENA_BLOCK 16384
+#define ARENA_MAX (1024 * 1024)
+
+typedef struct _block {
+    struct _block *next;
+    size_t         size;
+    char           bytes[];
+} * Block;
+
+typedef struct _arena {
+    Block  head;
+    Block  cur;
+    char * tail;
+    char * end;
+    size_t size;  // total bytes in all blocks
+} * Arena;
+
 #define MISS_AUTO 'A'
 #define MISS_RAISE 'R'
 #define MISS_IGNORE 'I'
@@ -64,12 +104,15 @@ typedef struct _delegate {
     Key ktail;
     Key kend;
 
+    struct _arena arena;
+
     VALUE (*get_key)(ojParser p, Key kp);
     struct _cache *key_cache;  // same as str_cache or sym_cache
     struct _cache *str_cache;
     struct _cache *sym_cache;
     struct _cache *class_cache;
     struct _cache *attr_cache;
+    Shape          shapes;  // NULL if shapes are not cached
 
     VALUE array_class;
     VALUE hash_class;
@@ -80,12 +123,16 @@ typedef struct _delegate {
     uint8_t cache_xrate;
     uint8_t miss_class;
     bool    cache_keys;
+    bool    cache_shapes;
     bool    ignore_json_create;
+    bool    array_bulk;  // array_class is an Array subclass
+    bool    hash_bulk;   // hash_class is a Hash subclass
 } * Delegate;
 
-static ID to_f_id = 0;
-static ID ltlt_id = 0;
-static ID hset_id = 0;
+static ID to_f_id       = 0;
+static ID ltlt_id       = 0;
+static ID hset_id       = 0;
+static ID initialize_id = 0;
 
 static char *str_dup(const char *s, size_t len) {
     char *d = ALLOC_N(char, len + 1);
@@ -96,6 +143,82 @@ static char *str_dup(const char *s, size_t len) {
     return d;
 }
 
+static void arena_rewind(Arena a) {
+    a->cur = a->head;
+    if (NULL == a->head) {
+        a->tail = NULL;
+        a->end  = NULL;
+    } else {
+        a->tail = a->head->bytes;
+        a->end  = a->head->bytes + a->head->size;
+    }
+}
+
+// Keeps only the first block.
+static void arena_release(Arena a) {
+    if (NULL != a->head) {
+        Block b;
+
+        while (NULL != (b = a->head->next)) {
+            a->head->next = b->next;
+            a->size -= b->size;
+            xfree(b);
+        }
+    }
+    arena_rewind(a);
+}
+
+static void arena_free(Arena a) {
+    Block b;
+
+    while (NULL != (b = a->head)) {
+        a->head = b->next;
+        xfree(b);
+    }
+    a->size = 0;
+    arena_rewind(a);
+}
+
+// Returns NULL if the arena is full.
+static char *arena_alloc(Arena a, size_t len) {
+    char *s;
+
+    if ((size_t)(a->end - a->tail) < len) {
+        Block b = (NULL == a->cur) ? NULL : a->cur->next;
+
+        if (NULL == b || b->size < len) {
+            size_t size = (len < ARENA_BLOCK) ? ARENA_BLOCK : len;
+
+            if (ARENA_MAX < a->size + size) {
+                return NULL;
+            }
+            b       = (Block)ALLOC_N(char, sizeof(struct _block) + size);
+            b->size = size;
+            a->size += size;
+            if (NULL == a->cur) {
+                b->next = NULL;
+                a->head = b;
+            } else {
+                b->next      = a->cur->next;
+                a->cur->next = b;
+            }
+        }
+        a->cur  = b;
+        a->tail = b->bytes;
+        a->end  = b->bytes + b->size;
+    }
+    s = a->tail;
+    a->tail += len;
+
+    return s;
+}
+
+inline static void key_free(Key kp) {
+    if (sizeof(kp->buf) <= (size_t)kp->len && kp->heap) {
+        xfree(kp->key);
+    }
+}
+
 static VALUE form_str(const char *str, size_t len) {
     return rb_str_freeze(rb_utf8_str_new(str, len));
 }
@@ -217,9 +340,9 @@ static VALUE cache_key(ojParser p, Key kp) {
 
 static VALUE str_key(ojParser p, Key kp) {
     if ((size_t)kp->len < sizeof(kp->buf)) {
-        return rb_str_freeze(rb_utf8_str_new(kp->buf, kp->len));
+        return rb_str_freeze(oj_str_cr(rb_utf8_str_new(kp->buf, kp->len), kp->cr));
     }
-    return rb_str_freeze(rb_utf8_str_new(kp->key, kp->len));
+    return rb_str_freeze(oj_str_cr(rb_utf8_str_new(kp->key, kp->len), kp->cr));
 }
 
 static VALUE sym_key(ojParser p, Key kp) {
@@ -238,6 +361,149 @@ static ID get_attr_id(ojParser p, Key kp) {
     return (ID)cache_intern(d->attr_cache, kp->key, kp->len);
 }
 
+inline static const char *key_bytes(Key kp) {
+    if ((size_t)kp->len < sizeof(kp->buf)) {
+        return kp->buf;
+    }
+    return kp->key;
+}
+
+static uint64_t shape_hash(Key kp, Key end) {
+    uint64_t h = 14695981039346656037ULL;
+
+    for (; kp < end; kp++) {
+        const uint8_t *b    = (const uint8_t *)key_bytes(kp);
+        const uint8_t *bend = b + kp->len;
+
+        h = (h ^ (uint64_t)kp->len) * 1099511628211ULL;
+        for (; b < bend; b++) {
+            h = (h ^ *b) * 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+static bool shape_match(Shape s, Key kp, Key end) {
+    const char *b = s->bytes;
+
+    if (s->cnt != end - kp) {
+        return false;
+    }
+    for (; kp < end; kp++) {
+        int16_t len;
+
+        memcpy(&len, b, sizeof(len));
+        b += sizeof(len);
+        if (len != kp->len || 0 != memcmp(b, key_bytes(kp), len)) {
+            return false;
+        }
+        b += len;
+    }
+    return true;
+}
+
+static void shape_set(Shape s, uint64_t h, Key kp, Key end, VALUE *vp) {
+    size_t blen = 0;
+    Key    k;
+    char * b;
+    int    i;
+
+    for (k = kp; k < end; k++) {
+        blen += sizeof(int16_t) + k->len;
+    }
+    if (s->blen < blen) {
+        REALLOC_N(s->bytes, char, blen);
+        s->blen = blen;
+    }
+    if (s->cnt < end - kp) {
+        REALLOC_N(s->keys, VALUE, end - kp);
+    }
+    s->hash = h;
+    s->cnt  = (int)(end - kp);
+    for (b = s->bytes, i = 0; kp < end; kp++, vp += 2, i++) {
+        memcpy(b, &kp->len, sizeof(kp->len));
+        b += sizeof(kp->len);
+        memcpy(b, key_bytes(kp), kp->len);
+        b += kp->len;
+        s->keys[i] = *vp;
+    }
+}
+
+static void shapes_free(Delegate d) {
+    Shape s;
+
+    if (NULL == d->shapes) {
+        return;
+    }
+    for (s = d->shapes; s < d->shapes + SHAPE_CNT; s++) {
+        xfree(s->bytes);
+        xfree(s->keys);
+    }
+    xfree(d->shapes);
+    d->shapes = NULL;
+}
+
+static void shapes_clear(Delegate d) {
+    Shape s;
+
+    if (NULL == d->shapes) {
+        return;
+    }
+    for (s = d->shapes; s < d->shapes + SHAPE_CNT; s++) {
+        s->hash = 0;
+        s->cnt  = 0;
+    }
+}
+
+// Shapes hold key VALUEs so they are only used when keys are cached and are
+// dropped whenever the type of key changes.
+static void shapes_update(Delegate d) {
+    if (d->cache_shapes && d->cache_keys) {
+        if (NULL == d->shapes) {
+            d->shapes = ALLOC_N(struct _shape, SHAPE_CNT);
+            memset(d->shapes, 0, sizeof(struct _shape) * SHAPE_CNT);
+        }
+        shapes_clear(d);
+    } else {
+        shapes_free(d);
+    }
+}
+
+// Replaces the key place holders in front of each value with the keys and
+// frees the long keys. If the shape of the object has been seen before the
+// keys of the shape are used.
+static void set_keys(ojParser p, Key kp, VALUE *head) {
+    Delegate d   = (Delegate)p->ctx;
+    Key      end = d->ktail;
+    Key      k;
+    VALUE *  vp;
+    Shape    s = NULL;
+    uint64_t h = 0;
+
+    if (NULL != d->shapes && kp < end && end - kp <= SHAPE_MAX_KEYS) {
+        h = shape_hash(kp, end);
+        s = d->shapes + (h & (SHAPE_CNT - 1));
+        if (s->hash == h && shape_match(s, kp, end)) {
+            VALUE *keys = s->keys;
+
+            for (vp = head; kp < end; kp++, vp += 2, keys++) {
+                *vp = *keys;
+                key_free(kp);
+            }
+            return;
+        }
+    }
+    for (vp = head, k = kp; k < end; k++, vp += 2) {
+        *vp = d->get_key(p, k);
+    }
+    if (NULL != s) {
+        shape_set(s, h, kp, end, head);
+    }
+    for (; kp < end; kp++) {
+        key_free(kp);
+    }
+}
+
 static void push_key(ojParser p) {
     Delegate    d    = (Delegate)p->ctx;
     size_t      klen = buf_len(&p->key);
@@ -252,12 +518,27 @@ static void push_key(ojParser p) {
         d->ktail = d->khead + pos;
         d->kend  = d->khead + cap;
     }
+    // With no keys on the stack nothing refers to the arena.
+    if (d->ktail == d->khead) {
+        arena_rewind(&d->arena);
+    }
     d->ktail->len = klen;
+    d->ktail->cr  = p->key_cr;
     if (klen < sizeof(d->ktail->buf)) {
         memcpy(d->ktail->buf, key, klen);
         d->ktail->buf[klen] = '\0';
     } else {
-        d->ktail->key = str_dup(key, klen);
+        char *k = arena_alloc(&d->arena, klen + 1);
+
+        if (NULL == k) {
+            d->ktail->key  = str_dup(key, klen);
+            d->ktail->heap = true;
+        } else {
+            memcpy(k, key, klen);
+            k[klen]        = '\0';
+            d->ktail->key  = k;
+            d->ktail->heap = false;
+        }
     }
     d->ktail++;
 }
@@ -322,8 +603,55 @@ static void open_array_key(ojParser p) {
     push2(p, Qundef);
 }
 
+// The number of members is known when an object closes so the Hash can be
+// created with room for all of them.
+inline static VALUE hash_new(long cnt) {
+#if HAVE_RB_HASH_NEW_CAPA
+    return rb_hash_new_capa(cnt);
+#else
+    return rb_hash_new();
+#endif
+}
+
+// An instance of an Array or Hash subclass that has not replaced initialize
+// only needs to be allocated.
+static VALUE class_new(VALUE clas) {
+    if (rb_method_basic_definition_p(clas, initialize_id)) {
+        return rb_obj_alloc(clas);
+    }
+    return rb_class_new_instance(0, NULL, clas);
+}
+
+// Creates an instance of the hash_class with the members of the object. A
+// subclass of Hash that has not replaced []= is filled with the C API instead
+// of a method call for each member.
+static VALUE hash_class_new(ojParser p, Key kp, VALUE *head) {
+    Delegate       d = (Delegate)p->ctx;
+    volatile VALUE obj;
+    VALUE *        vp;
+
+    if (d->hash_bulk && rb_method_basic_definition_p(d->hash_class, hset_id)) {
+        obj = class_new(d->hash_class);
+#if HAVE_RB_HASH_BULK_INSERT
+        set_keys(p, kp, head);
+        rb_hash_bulk_insert(d->vtail - head, head, obj);
+#else
+        for (vp = head; kp < d->ktail; kp++, vp += 2) {
+            rb_hash_aset(obj, d->get_key(p, kp), *(vp + 1));
+            key_free(kp);
+        }
+#endif
+        return obj;
+    }
+    obj = rb_class_new_instance(0, NULL, d->hash_class);
+    for (vp = head; kp < d->ktail; kp++, vp += 2) {
+        rb_funcall(obj, hset_id, 2, d->get_key(p, kp), *(vp + 1));
+        key_free(kp);
+    }
+    return obj;
+}
+
 static void close_object(ojParser p) {
-    VALUE *  vp;
     Delegate d = (Delegate)p->ctx;
 
     d->ctail--;
@@ -331,22 +659,17 @@ static void close_object(ojParser p) {
     Col            c    = d->ctail;
     Key            kp   = d->khead + c->ki;
     VALUE *        head = d->vhead + c->vi + 1;
-    volatile VALUE obj  = rb_hash_new();
+    volatile VALUE obj  = hash_new((d->vtail - head) / 2);
 
 #if HAVE_RB_HASH_BULK_INSERT
-    for (vp = head; kp < d->ktail; kp++, vp += 2) {
-        *vp = d->get_key(p, kp);
-        if (sizeof(kp->buf) <= (size_t)kp->len) {
-            xfree(kp->key);
-        }
-    }
+    set_keys(p, kp, head);
     rb_hash_bulk_insert(d->vtail - head, head, obj);
 #else
+    VALUE *vp;
+
     for (vp = head; kp < d->ktail; kp++, vp += 2) {
         rb_hash_aset(obj, d->get_key(p, kp), *(vp + 1));
-        if (sizeof(kp->buf) <= (size_t)kp->len) {
-            xfree(kp->key);
-        }
+        key_free(kp);
     }
 #endif
     d->ktail = d->khead + c->ki;
@@ -356,7 +679,6 @@ static void close_object(ojParser p) {
 }
 
 static void close_object_class(ojParser p) {
-    VALUE *  vp;
     Delegate d = (Delegate)p->ctx;
 
     d->ctail--;
@@ -364,14 +686,8 @@ static void close_object_class(ojParser p) {
     Col            c    = d->ctail;
     Key            kp   = d->khead + c->ki;
     VALUE *        head = d->vhead + c->vi + 1;
-    volatile VALUE obj  = rb_class_new_instance(0, NULL, d->hash_class);
+    volatile VALUE obj  = hash_class_new(p, kp, head);
 
-    for (vp = head; kp < d->ktail; kp++, vp += 2) {
-        rb_funcall(obj, hset_id, 2, d->get_key(p, kp), *(vp + 1));
-        if (sizeof(kp->buf) <= (size_t)kp->len) {
-            xfree(kp->key);
-        }
-    }
     d->ktail = d->khead + c->ki;
     d->vtail = head;
     head--;
@@ -392,31 +708,18 @@ static void close_object_create(ojParser p) {
     if (Qundef == *head) {
         head++;
         if (Qnil == d->hash_class) {
-            obj = rb_hash_new();
+            obj = hash_new((d->vtail - head) / 2);
 #if HAVE_RB_HASH_BULK_INSERT
-            for (vp = head; kp < d->ktail; kp++, vp += 2) {
-                *vp = d->get_key(p, kp);
-                if (sizeof(kp->buf) <= (size_t)kp->len) {
-                    xfree(kp->key);
-                }
-            }
+            set_keys(p, kp, head);
             rb_hash_bulk_insert(d->vtail - head, head, obj);
 #else
             for (vp = head; kp < d->ktail; kp++, vp += 2) {
                 rb_hash_aset(obj, d->get_key(p, kp), *(vp + 1));
-                if (sizeof(kp->buf) <= (size_t)kp->len) {
-                    xfree(kp->key);
-                }
+                key_free(kp);
             }
 #endif
         } else {
-            obj = rb_class_new_instance(0, NULL, d->hash_class);
-            for (vp = head; kp < d->ktail; kp++, vp += 2) {
-                rb_funcall(obj, hset_id, 2, d->get_key(p, kp), *(vp + 1));
-                if (sizeof(kp->buf) <= (size_t)kp->len) {
-                    xfree(kp->key);
-                }
-            }
+            obj = hash_class_new(p, kp, head);
         }
     } else {
         VALUE clas = *head;
@@ -426,19 +729,12 @@ static void close_object_create(ojParser p) {
             volatile VALUE arg = rb_hash_new();
 
 #if HAVE_RB_HASH_BULK_INSERT
-            for (vp = head; kp < d->ktail; kp++, vp += 2) {
-                *vp = d->get_key(p, kp);
-                if (sizeof(kp->buf) <= (size_t)kp->len) {
-                    xfree(kp->key);
-                }
-            }
+            set_keys(p, kp, head);
             rb_hash_bulk_insert(d->vtail - head, head, arg);
 #else
             for (vp = head; kp < d->ktail; kp++, vp += 2) {
                 rb_hash_aset(arg, d->get_key(p, kp), *(vp + 1));
-                if (sizeof(kp->buf) <= (size_t)kp->len) {
-                    xfree(kp->key);
-                }
+                key_free(kp);
             }
 #endif
             obj = rb_funcall(clas, oj_json_create_id, 1, arg);
@@ -446,9 +742,7 @@ static void close_object_create(ojParser p) {
             obj = rb_class_new_instance(0, NULL, clas);
             for (vp = head; kp < d->ktail; kp++, vp += 2) {
                 rb_ivar_set(obj, get_attr_id(p, kp), *(vp + 1));
-                if (sizeof(kp->buf) <= (size_t)kp->len) {
-                    xfree(kp->key);
-                }
+                key_free(kp);
             }
         }
     }
@@ -476,10 +770,17 @@ static void close_array_class(ojParser p) {
 
     d->ctail--;
     VALUE *        head = d->vhead + d->ctail->vi + 1;
-    volatile VALUE a    = rb_class_new_instance(0, NULL, d->array_class);
+    volatile VALUE a;
 
-    for (vp = head; vp < d->vtail; vp++) {
-        rb_funcall(a, ltlt_id, 1, *vp);
+    // A subclass of Array that has not replaced << is filled all at once.
+    if (d->array_bulk && rb_method_basic_definition_p(d->array_class, ltlt_id)) {
+        a = class_new(d->array_class);
+        rb_ary_cat(a, head, d->vtail - head);
+    } else {
+        a = rb_class_new_instance(0, NULL, d->array_class);
+        for (vp = head; vp < d->vtail; vp++) {
+            rb_funcall(a, ltlt_id, 1, *vp);
+        }
     }
     d->vtail = head;
     head--;
@@ -562,17 +863,15 @@ static void add_big_key(ojParser p) {
     push2(p, rb_funcall(rb_cObject, oj_bigdecimal_id, 1, rb_str_new(buf_str(&p->buf), buf_len(&p->buf))));
 }
 
+// The buf holds all the digits so the Ruby strtod gives a correctly rounded
+// result without creating a BigDecimal first.
 static void add_big_as_float(ojParser p) {
-    volatile VALUE big = rb_funcall(rb_cObject, oj_bigdecimal_id, 1, rb_str_new(buf_str(&p->buf), buf_len(&p->buf)));
-
-    push(p, rb_funcall(big, to_f_id, 0));
+    push(p, rb_float_new(rb_cstr_to_dbl(buf_str(&p->buf), 0)));
 }
 
 static void add_big_as_float_key(ojParser p) {
-    volatile VALUE big = rb_funcall(rb_cObject, oj_bigdecimal_id, 1, rb_str_new(buf_str(&p->buf), buf_len(&p->buf)));
-
     push_key(p);
-    push2(p, rb_funcall(big, to_f_id, 0));
+    push2(p, rb_float_new(rb_cstr_to_dbl(buf_str(&p->buf), 0)));
 }
 
 static void add_big_as_ruby(ojParser p) {
@@ -584,31 +883,30 @@ static void add_big_as_ruby_key(ojParser p) {
     push2(p, rb_funcall(rb_str_new(buf_str(&p->buf), buf_len(&p->buf)), to_f_id, 0));
 }
 
+static VALUE str_value(ojParser p, const char *str, size_t len) {
+    Delegate d = (Delegate)p->ctx;
+
+    if (len < d->cache_str) {
+        return cache_intern(d->str_cache, str, len);
+    }
+    return oj_str_cr(rb_utf8_str_new(str, len), p->buf_cr);
+}
+
 static void add_str(ojParser p) {
-    Delegate       d = (Delegate)p->ctx;
     volatile VALUE rstr;
     const char *   str = buf_str(&p->buf);
     size_t         len = buf_len(&p->buf);
 
-    if (len < d->cache_str) {
-        rstr = cache_intern(d->str_cache, str, len);
-    } else {
-        rstr = rb_utf8_str_new(str, len);
-    }
+    rstr = str_value(p, str, len);
     push(p, rstr);
 }
 
 static void add_str_key(ojParser p) {
-    Delegate       d = (Delegate)p->ctx;
     volatile VALUE rstr;
     const char *   str = buf_str(&p->buf);
     size_t         len = buf_len(&p->buf);
 
-    if (len < d->cache_str) {
-        rstr = cache_intern(d->str_cache, str, len);
-    } else {
-        rstr = rb_utf8_str_new(str, len);
-    }
+    rstr = str_value(p, str, len);
     push_key(p);
     push2(p, rstr);
 }
@@ -635,14 +933,10 @@ static void add_str_key_create(ojParser p) {
             return;
         }
         if (MISS_RAISE == d->miss_class) {
-            rb_raise(rb_eLoadError, "%s is not define", str);
+            rb_raise(rb_eLoadError, "%.*s is not define", (int)len, str);
         }
     }
-    if (len < d->cache_str) {
-        rstr = cache_intern(d->str_cache, str, len);
-    } else {
-        rstr = rb_utf8_str_new(str, len);
-    }
+    rstr = str_value(p, str, len);
     push_key(p);
     push2(p, rstr);
 }
@@ -662,6 +956,7 @@ static void start(ojParser p) {
     d->vtail = d->vhead;
     d->ctail = d->chead;
     d->ktail = d->khead;
+    arena_release(&d->arena);
 }
 
 static void dfree(ojParser p) {
@@ -675,6 +970,8 @@ static void dfree(ojParser p) {
     if (NULL != d->class_cache) {
         cache_free(d->class_cache);
     }
+    shapes_free(d);
+    arena_free(&d->arena);
     xfree(d->vhead);
     xfree(d->chead);
     xfree(d->khead);
@@ -705,7 +1002,50 @@ static void mark(ojParser p) {
             rb_gc_mark(*vp);
         }
     }
+    if (NULL != d->shapes) {
+        Shape s;
+
+        for (s = d->shapes; s < d->shapes + SHAPE_CNT; s++) {
+            for (vp = s->keys; vp < s->keys + s->cnt; vp++) {
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+                rb_gc_mark_movable(*vp);
+#else
+                rb_gc_mark(*vp);
+#endif
+            }
+        }
+    }
+}
+
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+// The value stack stays pinned since the values on it are also held in C
+// locals while a document is being built. Only the caches and shape keys
+// move.
+static void compact(ojParser p) {
+    Delegate d = (Delegate)p->ctx;
+
+    if (NULL == d) {
+        return;
+    }
+    cache_compact(d->str_cache);
+    if (NULL != d->sym_cache) {
+        cache_compact(d->sym_cache);
+    }
+    if (NULL != d->class_cache) {
+        cache_compact(d->class_cache);
+    }
+    if (NULL != d->shapes) {
+        Shape  s;
+        VALUE *vp;
+
+        for (s = d->shapes; s < d->shapes + SHAPE_CNT; s++) {
+            for (vp = s->keys; vp < s->keys + s->cnt; vp++) {
+                *vp = rb_gc_location(*vp);
+            }
+        }
+    }
 }
+#endif
 
 ///// options /////////////////////////////////////////////////////////////////
 
@@ -742,6 +1082,7 @@ static VALUE opt_array_class_set(ojParser p, VALUE value) {
         p->funcs[OBJECT_FUN].close_array = close_array_class;
     }
     d->array_class = value;
+    d->array_bulk  = (Qnil != value && Qtrue == rb_class_inherited_p(value, rb_cArray));
 
     return d->array_class;
 }
@@ -771,9 +1112,26 @@ static VALUE opt_cache_keys_set(ojParser p, VALUE value) {
             d->get_key = sym_key;
         }
     }
+    shapes_update(d);
+
     return d->cache_keys ? Qtrue : Qfalse;
 }
 
+static VALUE opt_cache_shapes(ojParser p, VALUE value) {
+    Delegate d = (Delegate)p->ctx;
+
+    return d->cache_shapes ? Qtrue : Qfalse;
+}
+
+static VALUE opt_cache_shapes_set(ojParser p, VALUE value) {
+    Delegate d = (Delegate)p->ctx;
+
+    d->cache_shapes = (Qtrue == value);
+    shapes_update(d);
+
+    return d->cache_shapes ? Qtrue : Qfalse;
+}
+
 static VALUE opt_cache_strings(ojParser p, VALUE value) {
     Delegate d = (Delegate)p->ctx;
 
@@ -818,6 +1176,21 @@ static VALUE opt_cache_expunge_set(ojParser p, VALUE value) {
     return INT2NUM((int)rate);
 }
 
+static VALUE opt_cache_stats(ojParser p, VALUE value) {
+    Delegate d = (Delegate)p->ctx;
+    VALUE    h = rb_hash_new();
+
+    rb_hash_aset(h, ID2SYM(rb_intern("str")), cache_stats(d->str_cache));
+    if (NULL != d->sym_cache) {
+        rb_hash_aset(h, ID2SYM(rb_intern("sym")), cache_stats(d->sym_cache));
+    }
+    rb_hash_aset(h, ID2SYM(rb_intern("attr")), cache_stats(d->attr_cache));
+    if (NULL != d->class_cache) {
+        rb_hash_aset(h, ID2SYM(rb_intern("class")), cache_stats(d->class_cache));
+    }
+    return h;
+}
+
 static VALUE opt_capacity(ojParser p, VALUE value) {
     Delegate d = (Delegate)p->ctx;
 
@@ -1000,6 +1373,7 @@ static VALUE opt_hash_class_set(ojParser p, VALUE value) {
         }
     }
     d->hash_class = value;
+    d->hash_bulk  = (Qnil != value && Qtrue == rb_class_inherited_p(value, rb_cHash));
     if (NULL == d->create_id) {
         if (Qnil == value) {
             p->funcs[TOP_FUN].close_object    = close_object;
@@ -1090,6 +1464,14 @@ static VALUE opt_omit_null_set(ojParser p, VALUE value) {
     return (noop == p->funcs[OBJECT_FUN].add_null) ? Qtrue : Qfalse;
 }
 
+static VALUE opt_register_keys(ojParser p, VALUE value) {
+    Delegate d = (Delegate)p->ctx;
+
+    cache_register(d->key_cache, value);
+
+    return Qnil;
+}
+
 static VALUE opt_symbol_keys(ojParser p, VALUE value) {
     Delegate d = (Delegate)p->ctx;
 
@@ -1115,6 +1497,8 @@ static VALUE opt_symbol_keys_set(ojParser p, VALUE value) {
             d->get_key = str_key;
         }
     }
+    shapes_update(d);
+
     return (NULL != d->sym_cache) ? Qtrue : Qfalse;
 }
 
@@ -1127,8 +1511,11 @@ static VALUE option(ojParser p, const char *key, VALUE value) {
         {.name = "cache_keys=", .func = opt_cache_keys_set},
         {.name = "cache_strings", .func = opt_cache_strings},
         {.name = "cache_strings=", .func = opt_cache_strings_set},
+        {.name = "cache_shapes", .func = opt_cache_shapes},
+        {.name = "cache_shapes=", .func = opt_cache_shapes_set},
         {.name = "cache_expunge", .func = opt_cache_expunge},
         {.name = "cache_expunge=", .func = opt_cache_expunge_set},
+        {.name = "cache_stats", .func = opt_cache_stats},
         {.name = "capacity", .func = opt_capacity},
         {.name = "capacity=", .func = opt_capacity_set},
         {.name = "class_cache", .func = opt_class_cache},
@@ -1145,6 +1532,7 @@ static VALUE option(ojParser p, const char *key, VALUE value) {
         {.name = "missing_class=", .func = opt_missing_class_set},
         {.name = "omit_null", .func = opt_omit_null},
         {.name = "omit_null=", .func = opt_omit_null_set},
+        {.name = "register_keys", .func = opt_register_keys},
         {.name = "symbol_keys", .func = opt_symbol_keys},
         {.name = "symbol_keys=", .func = opt_symbol_keys_set},
         {.name = NULL},
@@ -1174,6 +1562,10 @@ void oj_set_parser_usual(ojParser p) {
     d->kend  = d->khead + cap;
     d->ktail = d->khead;
 
+    d->arena.head = NULL;
+    d->arena.size = 0;
+    arena_rewind(&d->arena);
+
     cap      = 256;
     d->chead = ALLOC_N(struct _col, cap);
     d->cend  = d->chead + cap;
@@ -1181,10 +1573,13 @@ void oj_set_parser_usual(ojParser p) {
 
     d->get_key            = cache_key;
     d->cache_keys         = true;
+    d->cache_shapes       = true;
     d->ignore_json_create = false;
     d->cache_str          = 6;
     d->array_class        = Qnil;
     d->hash_class         = Qnil;
+    d->array_bulk         = false;
+    d->hash_bulk          = false;
     d->create_id          = NULL;
     d->create_id_len      = 0;
     d->miss_class         = MISS_IGNORE;
@@ -1234,6 +1629,8 @@ void oj_set_parser_usual(ojParser p) {
     d->sym_cache   = NULL;
     d->class_cache = NULL;
     d->key_cache   = d->str_cache;
+    d->shapes      = NULL;
+    shapes_update(d);
 
     p->ctx    = (void *)d;
     p->option = option;
@@ -1241,6 +1638,9 @@ void oj_set_parser_usual(ojParser p) {
     p->free   = dfree;
     p->mark   = mark;
     p->start  = start;
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+    p->compact = compact;
+#endif
 
     if (0 == to_f_id) {
         to_f_id = rb_intern("to_f");
@@ -1251,4 +1651,7 @@ void oj_set_parser_usual(ojParser p) {
     if (0 == hset_id) {
         hset_id = rb_intern("[]=");
     }
+    if (0 == initialize_id) {
+        initialize_id = rb_intern("initialize");
+    }
 }
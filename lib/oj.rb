@@ -6,6 +6,7 @@ require 'oj/version'
 require 'oj/bag'
 require 'oj/easy_hash'
 require 'oj/error'
+require 'oj/keys'
 require 'oj/mimic'
 require 'oj/saj'
 require 'oj/schandler'
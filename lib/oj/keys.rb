@@ -0,0 +1,19 @@
+module Oj
+
+  # Registers the keys in a JSON file that holds an Array of key Strings,
+  # usually one written earlier with Oj.save_keys().
+  # @param [String] path file to read the keys from
+  # @param [Boolean] symbols if true register in the Symbol key cache
+  def self.load_keys(path, symbols: false)
+    register_keys(load_file(path, mode: :strict), symbols: symbols)
+  end
+
+  # Writes the registered keys to a JSON file as an Array of Strings that
+  # can be loaded with Oj.load_keys() when a process starts.
+  # @param [String] path file to write the keys to
+  # @param [Boolean] symbols if true save the keys of the Symbol key cache
+  def self.save_keys(path, symbols: false)
+    to_file(path, registered_keys(symbols: symbols), mode: :strict)
+  end
+
+end # Oj
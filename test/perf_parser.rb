@@ -9,6 +9,8 @@ require 'optparse'
 require 'perf'
 require 'oj'
 require 'json'
+require 'etc'
+require 'tmpdir'
 
 $verbose = false
 $iter = 50_000
@@ -16,6 +18,7 @@ $with_bignum = false
 $size = 1
 $cache_keys = true
 $symbol_keys = false
+$str_len = 1024
 
 opts = OptionParser.new
 opts.on("-v", "verbose")                                  { $verbose = true }
@@ -24,6 +27,7 @@ opts.on("-s", "--size [Int]", Integer, "size (~Kbytes)")  { |i| $size = i }
 opts.on("-b", "with bignum")                              { $with_bignum = true }
 opts.on("-k", "no cache")                                 { $cache_keys = false }
 opts.on("-sym", "symbol keys")                            { $symbol_keys = true }
+opts.on("-l", "--length [Int]", Integer, "long string length") { |i| $str_len = i }
 opts.on("-h", "--help", "Show this display")              { puts opts; Process.exit!(0) }
 files = opts.parse(ARGV)
 
@@ -126,6 +130,296 @@ perf.add('Oj::strict_load', '') { Oj.strict_load($json) }
 perf.add('JSON::Ext', 'parse') { JSON.load($json) }
 perf.run($iter)
 
+### Long Strings ######################
+
+# String heavy documents spend most of the parse time scanning string
+# bodies. Build with --without-simd to compare against the byte map scanner.
+
+$str_json = Oj.dump((0...(4 * $size)).map { |i|
+  {
+    'id' => i,
+    'title' => 'Lorem ipsum dolor sit amet, consectetur adipiscing elit.',
+    'body' => ('Sed ut perspiciatis unde omnis iste natus error sit voluptatem. ' * ($str_len / 64 + 1))[0, $str_len],
+  }
+})
+
+p_val = Oj::Parser.new(:validate)
+p_usual = Oj::Parser.new(:usual)
+
+puts '-' * 80
+puts "Long String Performance (#{$str_len} bytes)"
+perf = Perf.new()
+perf.add('Oj::Parser.validate', 'none') { p_val.parse($str_json) }
+perf.add('Oj::Parser.usual', '') { p_usual.parse($str_json) }
+perf.add('Oj::strict_load', '') { Oj.strict_load($str_json) }
+perf.add('JSON::Ext', 'parse') { JSON.load($str_json) }
+perf.run($iter)
+
+### Floats ######################
+
+# Float heavy documents such as coordinates and metrics. The decimal :float
+# option converts numbers with too many digits for the fast path without
+# creating a BigDecimal first.
+
+$float_json = Oj.dump((0...(64 * $size)).map { |i| [i * 0.3711, -i / 7.25, (i * 1.0e-3).round(6)] })
+
+p_auto = Oj::Parser.new(:usual)
+p_float = Oj::Parser.new(:usual, decimal: :float)
+
+puts '-' * 80
+puts "Float Performance"
+perf = Perf.new()
+perf.add('Oj::Parser.usual', 'auto') { p_auto.parse($float_json) }
+perf.add('Oj::Parser.usual', 'float') { p_float.parse($float_json) }
+perf.add('Oj::strict_load', '') { Oj.strict_load($float_json) }
+perf.add('JSON::Ext', 'parse') { JSON.load($float_json) }
+perf.run($iter)
+
+### Indented ######################
+
+# Pretty printed JSON spends time skipping indentation after each newline.
+# Compact JSON has no runs of white space and should not be affected by the
+# skipping.
+
+$indent_json = Oj.dump($obj, indent: 2)
+
+p_val = Oj::Parser.new(:validate)
+p_usual = Oj::Parser.new(:usual)
+
+puts '-' * 80
+puts "Indented Performance"
+perf = Perf.new()
+perf.add('Oj::Parser.validate', 'compact') { p_val.parse($json) }
+perf.add('Oj::Parser.validate', 'indented') { p_val.parse($indent_json) }
+perf.add('Oj::Parser.usual', 'compact') { p_usual.parse($json) }
+perf.add('Oj::Parser.usual', 'indented') { p_usual.parse($indent_json) }
+perf.run($iter)
+
+### Files ######################
+
+# Files are read in chunks of read_size bytes by default. Reading 16K at a
+# time is what the parser used to do. Regular files can also be memory
+# mapped with the mmap option.
+
+$file_path = File.join(Dir.tmpdir, 'oj_perf_parser.json')
+File.write($file_path, Oj.dump((0...(400 * $size)).map { $obj }))
+$file_iter = [$iter / 1000, 10].max
+
+p_mmap = Oj::Parser.new(:validate, mmap: true)
+p_read16 = Oj::Parser.new(:validate, read_size: 16384)
+p_read1m = Oj::Parser.new(:validate, read_size: 1048576)
+
+puts '-' * 80
+puts "File Performance (#{File.size($file_path) / 1024} KB)"
+perf = Perf.new()
+perf.add('Oj::Parser.file', 'mmap') { p_mmap.file($file_path) }
+perf.add('Oj::Parser.file', 'read 16K') { p_read16.file($file_path) }
+perf.add('Oj::Parser.file', 'read 1M') { p_read1m.file($file_path) }
+perf.run($file_iter)
+File.delete($file_path)
+
+### JSON Lines ######################
+
+# A JSON Lines file is split into chunks that are scanned on separate threads
+# while the documents are built in order on the calling thread. Compare with
+# reading the lines in Ruby and parsing each one, and with each or feed
+# yielding the documents of a stream. Each chunk is scanned onto a tape and
+# then replayed so one thread is slower than parsing each line directly. The
+# file is large enough to fill several batches of eight 4MB chunks so the
+# thread counts can be compared. Run on a machine with at least eight
+# processors to see the scaling.
+
+$lines_path = File.join(Dir.tmpdir, 'oj_perf_parser.ndjson')
+$line_obj = $obj.is_a?(Array) ? $obj[0] : $obj
+$line = Oj.dump($line_obj) + "\n"
+$lines_iter = [$iter / 10_000, 3].max
+File.write($lines_path, $line * (128 * 1024 * 1024 * [$size, 1].max / $line.size))
+
+p_line = Oj::Parser.new(:usual)
+p_lines = Oj::Parser.new(:usual)
+
+puts '-' * 80
+puts "JSON Lines Performance (#{File.size($lines_path) / 1024 / 1024} MB, #{Etc.nprocessors} processors)"
+perf = Perf.new()
+perf.add('Oj::Parser.usual', 'each line') { File.foreach($lines_path) { |line| p_line.parse(line) } }
+perf.add('Oj::Parser.each', 'stream') { File.open($lines_path) { |f| p_line.each(f) { |doc| } } }
+perf.add('Oj::Parser.feed', '64K') {
+  File.open($lines_path) { |f|
+    buf = +''
+    p_line.feed(buf) { |doc| } while f.read(65536, buf)
+    p_line.finish { |doc| }
+  }
+}
+[1, 2, 4, 8].each { |cnt|
+  pt = Oj::Parser.new(:usual, threads: cnt)
+  perf.add('Oj::Parser.file_lines', "#{cnt} thread#{1 < cnt ? 's' : ''}") { pt.file_lines($lines_path) { |docs| } }
+}
+perf.add('Oj::Parser.file_lines', 'threads') { p_lines.file_lines($lines_path) { |docs| } }
+perf.add('Oj::Parser.file_lines', 'pipe') {
+  IO.pipe { |r, w|
+    writer = Thread.new { IO.copy_stream($lines_path, w); w.close }
+    p_lines.file_lines("/dev/fd/#{r.fileno}") { |docs| }
+    writer.join
+  }
+}
+perf.run($lines_iter)
+File.delete($lines_path)
+
+### Lazy ######################
+
+# A few values are looked up in a large document. The usual delegate builds
+# everything while the lazy delegate only builds what is looked up.
+
+$sparse_json = Oj.dump({'id' => 1, 'user' => {'id' => 7}, 'items' => (0...(1000 * $size)).map { $line_obj }})
+p_sparse = Oj::Parser.new(:usual)
+p_lazy = Oj::Parser.new(:lazy)
+
+puts '-' * 80
+puts "Lazy Performance (#{$sparse_json.size / 1024} KB)"
+perf = Perf.new()
+perf.add('Oj::Parser.usual', 'sparse') { d = p_sparse.parse($sparse_json); [d['id'], d['user']['id'], d['items'][500]['a']] }
+perf.add('Oj::Parser.lazy', 'sparse') { d = p_lazy.parse($sparse_json); [d['id'], d.dig('user', 'id'), d.dig('items', 500, 'a')] }
+perf.run($file_iter)
+
+### Project ######################
+
+# The same values are picked out by paths given to the project delegate.
+
+p_project = Oj::Parser.new(:project, paths: ['id', 'user.id', 'items[500].a'])
+
+puts '-' * 80
+puts "Project Performance (#{$sparse_json.size / 1024} KB)"
+perf = Perf.new()
+perf.add('Oj::Parser.usual', 'sparse') { d = p_sparse.parse($sparse_json); [d['id'], d['user']['id'], d['items'][500]['a']] }
+perf.add('Oj::Parser.project', 'sparse') { p_project.parse($sparse_json) }
+perf.run($file_iter)
+
+### Schema ######################
+
+# Records are decoded into Structs. The usual delegate builds a Hash for each
+# record that is then copied into a Struct while the schema delegate fills the
+# Struct members directly.
+
+PerfUser = Struct.new(:id, :name, :admin)
+PerfEvent = Struct.new(:id, :kind, :user, :score, :tags)
+$events_json = Oj.dump((0...(1000 * [$size, 1].max)).map { |i|
+  {'id' => i, 'kind' => 'click', 'user' => {'id' => i % 97, 'name' => 'user', 'admin' => false}, 'score' => 1.5, 'tags' => ['a', 'b'], 'extra' => {'x' => [1, 2, 3]}}
+})
+p_records = Oj::Parser.new(:usual)
+p_schema = Oj::Parser.new(:schema, schema: PerfEvent, types: {PerfEvent => {user: PerfUser}})
+
+puts '-' * 80
+puts "Schema Performance (#{$events_json.size / 1024} KB)"
+perf = Perf.new()
+perf.add('Oj::Parser.usual', 'to Struct') {
+  p_records.parse($events_json).map { |h|
+    u = h['user']
+    PerfEvent.new(h['id'], h['kind'], PerfUser.new(u['id'], u['name'], u['admin']), h['score'], h['tags'])
+  }
+}
+perf.add('Oj::Parser.schema', 'Struct') { p_schema.parse($events_json) }
+perf.run($file_iter)
+
+### Shapes ######################
+
+# Records with the same keys reuse the keys of the object shape instead of a
+# key cache lookup for each key.
+
+p_shapes = Oj::Parser.new(:usual)
+p_no_shapes = Oj::Parser.new(:usual, cache_shapes: false)
+
+puts '-' * 80
+puts "Shape Cache Performance (#{$events_json.size / 1024} KB)"
+perf = Perf.new()
+perf.add('Oj::Parser.usual', 'no shapes') { p_no_shapes.parse($events_json) }
+perf.add('Oj::Parser.usual', 'shapes') { p_shapes.parse($events_json) }
+perf.run($file_iter)
+
+### Subclasses ######################
+
+# Subclasses of Array and Hash that keep the core << and []= are filled with
+# bulk inserts. One that replaces []= is called for each member.
+
+class PerfHash < Hash
+end
+
+class PerfArray < Array
+end
+
+class PerfSetHash < Hash
+  def []=(k, v)
+    super
+  end
+end
+
+p_sub = Oj::Parser.new(:usual, hash_class: PerfHash, array_class: PerfArray)
+p_set = Oj::Parser.new(:usual, hash_class: PerfSetHash)
+
+puts '-' * 80
+puts "Subclass Performance (#{$events_json.size / 1024} KB)"
+perf = Perf.new()
+perf.add('Oj::Parser.usual', 'Hash') { p_records.parse($events_json) }
+perf.add('Oj::Parser.usual', 'subclass') { p_sub.parse($events_json) }
+perf.add('Oj::Parser.usual', '[]= subclass') { p_set.parse($events_json) }
+perf.run($file_iter)
+
+### Release GVL ######################
+
+# Four threads parse a large document at the same time. With release_gvl the
+# scan of one document overlaps with building the objects of another.
+# Scaling depends on the number of processors.
+
+$big_json = Oj.dump((0...(400 * $size)).map { $obj })
+p_held = (0...4).map { Oj::Parser.new(:usual) }
+p_released = (0...4).map { Oj::Parser.new(:usual, release_gvl: 65536) }
+
+puts '-' * 80
+puts "Release GVL Performance (4 threads, #{$big_json.size / 1024} KB)"
+perf = Perf.new()
+perf.add('Oj::Parser.usual', 'held') { p_held.map { |p| Thread.new { p.parse($big_json) } }.each(&:join) }
+perf.add('Oj::Parser.usual', 'released') { p_released.map { |p| Thread.new { p.parse($big_json) } }.each(&:join) }
+perf.run($file_iter)
+
+### Key Cache ######################
+
+# Documents with 1K, 100K, and 1M distinct keys show how the key cache holds
+# up as it grows compared to not caching keys at all.
+
+[1_000, 100_000, 1_000_000].each { |n|
+  objs = (0...(n / 10)).map { |i| (0...10).to_h { |j| ['key_%07d' % (i * 10 + j), j] } }
+  json = Oj.dump(objs * [1000 / objs.size, 1].max, mode: :strict)
+  p_cached = Oj::Parser.new(:usual, cache_keys: true)
+  p_uncached = Oj::Parser.new(:usual, cache_keys: false)
+
+  puts '-' * 80
+  puts "Key Cache Performance (#{n} keys, #{json.size / 1024} KB)"
+  perf = Perf.new()
+  perf.add('Oj::Parser.usual', 'cached') { p_cached.parse(json) }
+  perf.add('Oj::Parser.usual', 'uncached') { p_uncached.parse(json) }
+  perf.run([$file_iter * 100_000 / n, 3].max)
+}
+
+### Cache Contention ######################
+
+# The same 64 loads are split across Ractors that go through the shared key
+# and string caches at the same time. Cache hits do not lock so the rate
+# should scale with the number of processors.
+
+if defined?(Ractor)
+  Warning[:experimental] = false
+  $cache_json = Oj.dump((0...(100 * $size)).map { $obj }, mode: :strict).freeze
+
+  puts '-' * 80
+  puts "Cache Contention Performance (#{$cache_json.size / 1024} KB)"
+  perf = Perf.new()
+  [1, 2, 4, 8, 16].each { |n|
+    perf.add('Oj.load', "#{n} ractors") {
+      (0...n).map { Ractor.new($cache_json, 64 / n) { |j, cnt| cnt.times { Oj.load(j, mode: :strict) } } }.each(&:take)
+    }
+  }
+  perf.run($file_iter)
+end
+
 ### Usual Objects ######################
 
 # Original Oj follows the JSON gem for creating objects which uses the class
@@ -13,6 +13,15 @@ ruby test_parser_saj.rb
 echo "----- Parser(:usual) tests (test_parser_usual.rb) -----"
 ruby test_parser_usual.rb
 
+echo "----- Parser(:lazy) tests (test_parser_lazy.rb) -----"
+ruby test_parser_lazy.rb
+
+echo "----- Parser(:project) tests (test_parser_project.rb) -----"
+ruby test_parser_project.rb
+
+echo "----- Parser(:schema) tests (test_parser_schema.rb) -----"
+ruby test_parser_schema.rb
+
 echo "----- Mimic tests (tests_mimic.rb) -----"
 ruby tests_mimic.rb
 
@@ -0,0 +1,85 @@
+#!/usr/bin/env ruby
+# encoding: utf-8
+
+$: << File.dirname(__FILE__)
+
+require 'helper'
+
+class LazyTest < Minitest::Test
+
+  JSON_DOC = %|{"a":[1,2.5,"x",{"b":null,"c":[true,false]}],"d":{"e":12345678901234567890123},"f":"ぴ"}|
+
+  def test_primitive
+    p = Oj::Parser.new(:lazy)
+    [
+      ['null', nil],
+      ['true', true],
+      ['123', 123],
+      ['1.25', 1.25],
+      ['"abc"', 'abc'],
+    ].each { |x|
+      assert_equal(x[1], p.parse(x[0]))
+    }
+  end
+
+  def test_lookup
+    p = Oj::Parser.new(:lazy)
+    doc = p.parse(JSON_DOC)
+    assert_equal(Oj::Parser::Lazy, doc.class)
+    assert_equal(3, doc.size)
+    assert_equal(%w[a d f], doc.keys)
+    assert(doc.key?('d'))
+    assert(!doc.key?('x'))
+    assert_equal(Oj::Parser::Lazy, doc['a'].class)
+    assert(doc['a'].array?)
+    assert_equal(4, doc[:a].size)
+    assert_equal(2.5, doc['a'][1])
+    assert_equal(false, doc['a'][3]['c'][-1])
+    assert_nil(doc['a'][4])
+    assert_nil(doc['x'])
+    assert_equal('ぴ', doc['f'])
+    assert_equal(true, doc.dig('a', 3, 'c', 0))
+    assert_equal(BigDecimal('12345678901234567890123'), doc.dig('d', 'e'))
+    assert_nil(doc.dig('x', 'y'))
+    assert_raises(TypeError) { doc.dig('a', 0, 1) }
+  end
+
+  def test_materialize
+    p = Oj::Parser.new(:lazy)
+    doc = p.parse(JSON_DOC)
+    expect = Oj::Parser.new(:usual).parse(JSON_DOC)
+    assert_equal(expect, doc.to_h)
+    assert_equal(expect, doc.to_ruby)
+    assert_equal(expect['a'], doc['a'].to_a)
+    assert_equal(expect['d'].to_a, doc['d'].to_a)
+    assert_raises(TypeError) { doc['a'].to_h }
+    assert_equal(expect.map { |k, v| [k, v.class] }, doc.each.map { |k, v| [k, v.is_a?(Oj::Parser::Lazy) ? v.to_ruby.class : v.class] })
+  end
+
+  def test_outlives_parser
+    # Each document keeps its own tape so earlier ones are not changed by
+    # later parses or by the parser being collected.
+    p = Oj::Parser.new(:lazy)
+    a = p.parse('{"x":[1,2]}')['x']
+    b = p.parse('{"x":[3,4]}')['x']
+    p = nil
+    GC.start
+    assert_equal([1, 2], a.to_a)
+    assert_equal([3, 4], b.to_a)
+    assert_equal([[1], {'a' => 2}, 3], Oj::Parser.new(:lazy).each('[1] {"a":2} 3').map { |d| d.is_a?(Oj::Parser::Lazy) ? d.to_ruby : d })
+  end
+
+  def test_memsize
+    require 'objspace'
+    json = Oj.dump((0...1000).map { |i| {'id' => i, 'name' => "name #{i}"} }, mode: :strict)
+    doc = Oj::Parser.new(:lazy).parse(json)
+    item = doc[999]
+    # The tape is counted on the root only.
+    assert_operator(ObjectSpace.memsize_of(doc), :>, json.size)
+    assert_operator(ObjectSpace.memsize_of(item), :<, 100)
+    doc = nil
+    GC.compact if GC.respond_to?(:compact)
+    assert_equal('name 999', item['name'])
+  end
+
+end
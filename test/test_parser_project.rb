@@ -0,0 +1,61 @@
+#!/usr/bin/env ruby
+# encoding: utf-8
+
+$: << File.dirname(__FILE__)
+
+require 'helper'
+
+class ProjectTest < Minitest::Test
+
+  JSON_DOC = %|{"user":{"id":7,"name":"ann"},"items":[{"sku":"a1","qty":2},{"sku":"b2","tags":["x"]},{"qty":1}],"meta":{"n":1.5,"big":12345678901234567890123,"ok":true}}|
+
+  def test_paths
+    p = Oj::Parser.new(:project, paths: ['user.id', 'items[*].sku', 'items[1].tags', 'meta.n', :'meta.ok'])
+    assert_equal(['user.id', 'items[*].sku', 'items[1].tags', 'meta.n', 'meta.ok'], p.paths)
+    assert_equal({
+                   'user.id' => 7,
+                   'items[*].sku' => ['a1', 'b2'],
+                   'items[1].tags' => ['x'],
+                   'meta.n' => 1.5,
+                   'meta.ok' => true,
+                 }, p.parse(JSON_DOC))
+    p.paths = ['meta.big', 'missing', 'user.id.x']
+    assert_equal({'meta.big' => BigDecimal('12345678901234567890123')}, p.parse(JSON_DOC))
+  end
+
+  def test_subtree
+    p = Oj::Parser.new(:project, paths: ['user', 'user.name', 'items[0]', '*.n'])
+    assert_equal({
+                   'user' => {'id' => 7, 'name' => 'ann'},
+                   'user.name' => 'ann',
+                   'items[0]' => {'sku' => 'a1', 'qty' => 2},
+                   '*.n' => [1.5],
+                 }, p.parse(JSON_DOC))
+  end
+
+  def test_array_document
+    p = Oj::Parser.new(:project, paths: ['[*].a', '[1]'])
+    assert_equal({'[*].a' => [1, nil], '[1]' => {'a' => nil}}, p.parse('[{"a":1},{"a":null},{"b":2}]'))
+    assert_equal({}, p.parse('7'))
+  end
+
+  def test_each
+    p = Oj::Parser.new(:project, paths: ['id'])
+    docs = []
+    p.each('{"id":1} {"x":2} {"id":3}') { |doc| docs << doc }
+    assert_equal([{'id' => 1}, {}, {'id' => 3}], docs)
+  end
+
+  def test_bad_path
+    ['', 'a.', '.a', 'a..b', 'a[', 'a[x]', 'a[1'].each { |path|
+      assert_raises(ArgumentError) { Oj::Parser.new(:project, paths: [path]) }
+    }
+  end
+
+  def test_bad_path_keeps_paths
+    p = Oj::Parser.new(:project, paths: ['x', 'y[*]'])
+    assert_raises(ArgumentError) { p.paths = ['a', 'b..c', 'd'] }
+    assert_equal(['x', 'y[*]'], p.paths)
+    assert_equal({'x' => 1, 'y[*]' => [2, 3]}, p.parse('{"a":0,"x":1,"y":[2,3],"d":4}'))
+  end
+end
@@ -0,0 +1,73 @@
+#!/usr/bin/env ruby
+# encoding: utf-8
+
+$: << File.dirname(__FILE__)
+
+require 'helper'
+
+class SchemaTest < Minitest::Test
+
+  Item = Struct.new(:sku, :qty)
+  Order = Struct.new(:id, :user, :items, :note)
+  Tree = Struct.new(:value, :kids)
+
+  JSON_DOC = %|{"id":1,"junk":{"a":[1,2]},"user":{"id":7,"name":"ann","extra":3},"items":[{"sku":"a1","qty":2,"x":"y"},{"sku":"b2"}],"note":{"k":[1,{"z":null}]}}|
+
+  def test_struct
+    p = Oj::Parser.new(:schema, schema: Order, types: {Order => {items: [Item]}})
+    assert_equal(Order, p.schema)
+    order = p.parse(JSON_DOC)
+    assert_equal(Order.new(1, {'id' => 7, 'name' => 'ann', 'extra' => 3}, [Item.new('a1', 2), Item.new('b2', nil)], {'k' => [1, {'z' => nil}]}), order)
+  end
+
+  def test_data
+    skip 'Data requires Ruby 3.2' unless defined?(Data) && Data.respond_to?(:define)
+    user = Data.define(:id, :name)
+    p = Oj::Parser.new(:schema, schema: Order, types: {Order => {user: user}})
+    order = p.parse(JSON_DOC)
+    assert_equal(user.new(id: 7, name: 'ann'), order.user)
+    assert_equal(user.new(id: 3, name: nil), p.parse('{"user":{"id":3}}').user)
+  end
+
+  def test_list
+    p = Oj::Parser.new(:schema, schema: Item)
+    assert_equal([Item.new('a', 1), Item.new('b', 2)], p.parse('[{"sku":"a","qty":1},{"qty":2,"sku":"b"}]'))
+    assert_equal(3, p.parse('3'))
+  end
+
+  def test_recursive
+    p = Oj::Parser.new(:schema, schema: Tree, types: {Tree => {kids: [Tree]}})
+    tree = p.parse('{"value":1,"kids":[{"value":2,"kids":[]},{"value":3}]}')
+    assert_equal(Tree.new(1, [Tree.new(2, []), Tree.new(3, nil)]), tree)
+  end
+
+  def test_rejected_schema
+    q = Oj::Parser.new(:schema, schema: Item)
+    assert_raises(ArgumentError) { q.schema = Hash }
+    assert_equal(Item, q.schema)
+    assert_equal(Item.new('a', 1), q.parse('{"sku":"a","qty":1}'))
+    assert_raises(ArgumentError) { q.types = {Item => {price: Item}} }
+    assert_nil(q.types)
+    assert_equal(Item.new('a', 1), q.parse('{"sku":"a","qty":1}'))
+  end
+
+  def test_gc_stress
+    order = Struct.new(:id, :items, :owner, :extra)
+    p = Oj::Parser.new(:schema, schema: order, types: {order => {items: [Item], owner: Item}})
+    json = %|{"id":1,"items":[{"sku":"a","qty":1}],"owner":{"sku":"o"},"extra":{"k":[1],"m":{"n":{"o":[2]}}}}|
+    expect = order.new(1, [Item.new('a', 1)], Item.new('o', nil), {'k' => [1], 'm' => {'n' => {'o' => [2]}}})
+    GC.stress = true
+    begin
+      result = p.parse(json)
+    ensure
+      GC.stress = false
+    end
+    assert_equal(expect, result)
+  end
+
+  def test_bad_schema
+    assert_raises(ArgumentError) { Oj::Parser.new(:schema, schema: String) }
+    assert_raises(ArgumentError) { Oj::Parser.new(:schema, schema: Item, types: {Item => {price: Item}}) }
+    assert_raises(ArgumentError) { Oj::Parser.new(:schema, schema: Struct.new(:a, keyword_init: true)) }
+  end
+end
@@ -4,6 +4,7 @@
 $: << File.dirname(__FILE__)
 
 require 'helper'
+require 'tempfile'
 
 class UsualTest < Minitest::Test
 
@@ -33,6 +34,27 @@ class UsualTest < Minitest::Test
     assert_equal(BigDecimal, doc.class)
     doc = p.parse('1234567890.1234567890123456789')
     assert_equal(BigDecimal, doc.class)
+    assert_equal(-12345678901234567890123, p.parse('-12345678901234567890123'))
+    assert_equal(BigDecimal('0.0034776585974550657'), p.parse('0.0034776585974550657'))
+    assert_equal(BigDecimal('1e4933'), p.parse('1e4933'))
+  end
+
+  def test_long_integers
+    p = Oj::Parser.new(:usual)
+    [
+      '12345678', '123456789', '1234567890123456', '1665000000000000000', '9223372036854775807',
+      '-9223372036854775807', '-12345678901234567',
+    ].each { |s|
+      doc = p.parse(s)
+      assert_equal(Integer, doc.class, s)
+      assert_equal(Integer(s), doc)
+    }
+    ['9223372036854775808', '-9223372036854775808', '123456789012345678901234'].each { |s|
+      doc = p.parse(s)
+      assert_equal(BigDecimal, doc.class, s)
+      assert_equal(Integer(s), doc)
+    }
+    assert_equal([12345678.87654321, 0.1234567812345678], p.parse('[12345678.87654321,0.1234567812345678]'))
   end
 
   def test_array
@@ -73,12 +95,323 @@ class UsualTest < Minitest::Test
     assert_equal({a: true, b: false}, doc)
   end
 
+  def test_cache_shapes
+    p = Oj::Parser.new(:usual)
+    assert_equal(true, p.cache_shapes)
+    long = 'k' * 40
+    json = %|[{"a":1,"b":2,"#{long}":3},{"b":1,"a":2},{"a":3,"b":4,"#{long}":5},{"a":5,"bb":6}]|
+    expect = [{'a' => 1, 'b' => 2, long => 3}, {'b' => 1, 'a' => 2}, {'a' => 3, 'b' => 4, long => 5}, {'a' => 5, 'bb' => 6}]
+    assert_equal(expect, p.parse(json))
+    assert_equal(expect, p.parse(json))
+
+    p.symbol_keys = true
+    assert_equal(expect.map { |h| h.transform_keys(&:to_sym) }, p.parse(json))
+
+    p.cache_shapes = false
+    assert_equal(false, p.cache_shapes)
+    assert_equal(expect.map { |h| h.transform_keys(&:to_sym) }, p.parse(json))
+  end
+
+  def test_coderange
+    require 'objspace'
+    cr = ->(s) { ObjectSpace.dump(s)[/"coderange":"(\w+)"/, 1] || 'unknown' }
+    json = %|{"key":["abc","ぴーたー","\\u00e9","x\\ny","\xC0\x80","\xED\xA0\x80"],"ké":1}|.b.force_encoding('UTF-8')
+    p = Oj::Parser.new(:usual, cache_keys: false, cache_strings: 0)
+    doc = p.parse(json)
+    assert_equal(%w[7bit valid], doc.keys.map { |k| cr.call(k) })
+    assert_equal(%w[7bit valid valid 7bit unknown unknown], doc['key'].map { |s| cr.call(s) })
+    assert(!doc['key'][4].valid_encoding?)
+    assert(!doc['key'][5].valid_encoding?)
+  end
+
   def test_strings
     p = Oj::Parser.new(:usual)
     doc = p.parse('{"ぴ": "", "ぴ ": "x", "c": "ぴーたー", "d": " ぴーたー "}')
     assert_equal({'ぴ' => '', 'ぴ ' => 'x', 'c' => 'ぴーたー', 'd' => ' ぴーたー '}, doc)
   end
 
+  def test_long_strings
+    p = Oj::Parser.new(:usual)
+    # Lengths that fall on either side of the SIMD vector widths.
+    [0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 130].each { |len|
+      base = 'x' * len
+      [
+        [%|"#{base}"|, base],
+        [%|"#{base}\\n#{base}"|, "#{base}\n#{base}"],
+        [%|"#{base}ぴ#{base}"|, "#{base}ぴ#{base}"],
+        [%|{"#{base}":"#{base}\\"z"}|, {base => "#{base}\"z"}],
+      ].each { |x|
+        doc = p.parse(x[0])
+        assert_equal(x[1], doc)
+      }
+      assert_raises(EncodingError) { p.parse(%|"#{base}\t"|) }
+    }
+  end
+
+  def test_long_keys
+    p = Oj::Parser.new(:usual, cache_keys: false)
+    # Long keys come from an arena and fall back to the heap once it is full.
+    [30, 1000, 20000].each { |len|
+      keys = (0...100).map { |i| "#{'k' * len}#{i}" }
+      doc = keys.each_slice(10).to_h { |ks| [ks[0], ks.to_h { |k| [k, {k => k.size}] }] }
+      json = Oj.dump(doc, mode: :strict)
+      assert_equal(doc, p.parse(json))
+      assert_equal(doc, p.parse(json))
+      docs = []
+      p.each(json + json) { |d| docs << d }
+      assert_equal([doc, doc], docs)
+    }
+  end
+
+  def test_cache_long_keys
+    p = Oj::Parser.new(:usual, cache_shapes: false)
+    key = 'k' * 200
+    json = %|{"#{key}":1}|
+    assert(p.parse(json).keys[0].equal?(p.parse(json).keys[0]))
+    key = 'k' * 2000
+    json = %|{"#{key}":1}|
+    assert_equal({key => 1}, p.parse(json))
+  end
+
+  def test_gc_compaction
+    json = %|{"abc":[1,"xyz",{"abc":true}],"def":{"ghi":null}}|
+    expect = {'abc' => [1, 'xyz', {'abc' => true}], 'def' => {'ghi' => nil}}
+    p = Oj::Parser.new(:usual)
+    p.cache_keys = true
+    p.symbol_keys = false
+    pc = Oj::Parser.new(:usual, create_id: '^', class_cache: true, missing_class: :auto)
+    pc.parse(%|{"^":"CompactAuto","a":1}|)
+    assert_equal(expect, p.parse(json))
+    assert_equal(expect, Oj.load(json, mode: :strict, cache_keys: true))
+    verify_gc_compaction
+    assert_equal(expect, p.parse(json))
+    assert_equal(expect, Oj.load(json, mode: :strict, cache_keys: true))
+    assert_equal('CompactAuto', pc.parse(%|{"^":"CompactAuto","a":1}|).class.name)
+    p.symbol_keys = true
+    assert_equal({abc: 1}, p.parse(%|{"abc":1}|))
+    verify_gc_compaction
+    assert_equal({abc: 1}, p.parse(%|{"abc":1}|))
+  end
+
+  def test_cache_stats
+    p = Oj::Parser.new(:usual, cache_shapes: false)
+    assert_equal([:str, :attr], p.cache_stats.keys)
+    p.parse(%|{"a":1,"b":[{"a":2}]}|)
+    stats = p.cache_stats[:str]
+    assert_equal(2, stats[:count])
+    assert_equal(2, stats[:misses])
+    assert_equal(1, stats[:hits])
+    p.symbol_keys = true
+    p.parse(%|{"a":1}|)
+    assert_equal(1, p.cache_stats[:sym][:misses])
+    (1..1000).each { |i| p.parse(%|{"k#{i}":1}|) }
+    stats = p.cache_stats[:sym]
+    assert_equal(1001, stats[:misses])
+    assert(0 < stats[:rehashes])
+  end
+
+  def test_register_keys
+    p = Oj::Parser.new(:usual, cache_shapes: false, cache_expunge: 3)
+    p.register_keys((1..1000).map { |i| "reg#{i}" })
+    key = p.parse(%|{"reg7":1}|).keys[0]
+    (1..5000).each { |i|
+      p.parse(%|{"tmp#{i}":1}|)
+      GC.start if 0 == i % 1000
+    }
+    assert(key.equal?(p.parse(%|{"reg7":1}|).keys[0]))
+    stats = p.cache_stats[:str]
+    assert_equal(1000, stats[:permanent])
+    assert(0 < stats[:expunged])
+  end
+
+  def test_indented
+    p = Oj::Parser.new(:usual)
+    obj = {'a' => [1, {'b' => [true, nil, 'c']}], 'd' => {'e' => {'f' => {'g' => {'h' => 2.5}}}}}
+    [2, 4, 20].each { |indent|
+      assert_equal(obj, p.parse(Oj.dump(obj, mode: :strict, indent: indent)))
+    }
+    json = Oj.dump(obj, mode: :strict, indent: 3).gsub("\n", "\r\n").gsub('   ', " \t ")
+    assert_equal(obj, p.parse(json))
+    assert_equal([1, 2], p.parse("[\n#{' ' * 40}1,#{' ' * 33}\t2#{' ' * 17}\n]"))
+  end
+
+  def test_range
+    p = Oj::Parser.new(:usual)
+    buf = %|{"a":1} [1,2]\n"str" 123\n4.5 true null\n|
+    docs = []
+    offset = 0
+    while offset < buf.bytesize
+      docs << p.parse(buf, offset)
+      offset += p.consumed
+    end
+    assert_equal([{'a' => 1}, [1, 2], 'str', 123, 4.5, true, nil], docs)
+
+    assert_equal([1, 2], p.parse('xx[1,2]yy', 2, 5))
+    assert_equal(5, p.consumed)
+    assert_equal(12, p.parse('xx1234', 2, 2))
+    assert_equal(true, p.parse('xxtrueyy', 2, 4))
+    assert_raises(EncodingError) { p.parse('xxtruyy', 2, 3) }
+    assert_raises(EncodingError) { p.parse('["abc"]', 0, 5) }
+    assert_raises(ArgumentError) { p.parse('[1,2]', 2, 9) }
+    assert_raises(ArgumentError) { p.parse('[1,2]', -1) }
+
+    # NUL is not a terminator.
+    assert_raises(EncodingError) { p.parse("[1]\0[2]") }
+  end
+
+  def test_file
+    obj = (0...500).map { |i| {'id' => i, 'name' => "name #{i}", 'vals' => [1.5, nil, true, -12345678901234]} }
+    json = Oj.dump(obj, mode: :strict)
+    assert_equal(false, Oj::Parser.new(:usual).mmap)
+    Tempfile.create(['oj_parser', '.json']) { |f|
+      f.write(json)
+      f.close
+      [true, false].each { |mmap|
+        p = Oj::Parser.new(:usual, mmap: mmap, read_size: 1024)
+        assert_equal(obj, p.file(f.path))
+      }
+      File.write(f.path, "[1,\n2,\n#{' ' * 2000}x]")
+      [true, false].each { |mmap|
+        p = Oj::Parser.new(:usual, mmap: mmap, read_size: 1024)
+        e = assert_raises(EncodingError) { p.file(f.path) }
+        assert_match(/at 3:2001/, e.message)
+      }
+    }
+    p = Oj::Parser.new(:usual, read_size: 1024)
+    assert_equal(obj, p.load(StringIO.new(json)))
+    assert_raises(ArgumentError) { p.read_size = 10 }
+  end
+
+  def test_file_lines
+    # Long enough to be split into more than one chunk.
+    # Keys and strings longer than the scan buffers make them grow off the
+    # Ruby threads.
+    docs = (0...3000).map { |i| {'id' => i, 'pad' => 'x' * 2000, 'k' * 1500 => [1.5, nil, true]} }
+    Tempfile.create(['oj_parser', '.ndjson']) { |f|
+      f.write(docs.map { |d| Oj.dump(d, mode: :strict) }.join("\n\n"))
+      f.close
+      [0, 1, 3].each { |threads|
+        p = Oj::Parser.new(:usual, threads: threads)
+        assert_equal(docs, p.file_lines(f.path))
+        chunks = []
+        assert_nil(p.file_lines(f.path) { |a| chunks << a })
+        assert_operator(chunks.size, :>, 1)
+        assert_equal(docs, chunks.flatten(1))
+      }
+      File.write(f.path, "[1]\n" * 2000 + "{\"a\":[1,2}\n" + "[2]\n" * 2000)
+      e = assert_raises(EncodingError) { Oj::Parser.new(:usual).file_lines(f.path) }
+      assert_match(/at 2001:11/, e.message)
+    }
+  end
+
+  def test_file_lines_fifo
+    skip 'no named pipes' unless File.respond_to?(:mkfifo) && !Gem.win_platform?
+
+    # One line longer than a chunk and enough others to fill several.
+    docs = [{'big' => 'x' * 5_000_000}] + (0...3000).map { |i| {'id' => i, 'pad' => 'y' * 3000} }
+    Dir.mktmpdir { |dir|
+      path = File.join(dir, 'docs.ndjson')
+      File.mkfifo(path)
+      [1, 3].each { |threads|
+        writer = Thread.new { File.write(path, docs.map { |d| Oj.dump(d, mode: :strict) }.join("\n")) }
+        assert_equal(docs, Oj::Parser.new(:usual, threads: threads).file_lines(path))
+        writer.join
+      }
+      writer = Thread.new { File.write(path, "[1]\n" * 2000 + "{\"a\":[1,2}\n" + "[2]\n" * 2000) }
+      e = assert_raises(EncodingError) { Oj::Parser.new(:usual).file_lines(path) }
+      writer.join
+      assert_match(/at 2001:11/, e.message)
+    }
+  end
+
+  def test_file_lines_interrupt
+    line = Oj.dump({'a' => (0...2000).to_a, 's' => 'z' * 1000}, mode: :strict)
+    Tempfile.create(['oj_parser', '.ndjson']) { |f|
+      f.write((line + "\n") * 5000)
+      f.close
+      p = Oj::Parser.new(:validate, threads: 2)
+      th = Thread.new { p.file_lines(f.path) }
+      th.report_on_exception = false
+      sleep 0.01
+      th.raise(RuntimeError, 'stop')
+      assert_raises(RuntimeError) { th.join }
+      assert_equal(5000, p.file_lines(f.path).size)
+    }
+  end
+
+  def test_each
+    p = Oj::Parser.new(:usual)
+    p.just_one = true
+    json = %|{"a":1} [1,2]\n"str" 123\n4.5 true null 7|
+    expect = [{'a' => 1}, [1, 2], 'str', 123, 4.5, true, nil, 7]
+    docs = []
+    assert_equal(p, p.each(json) { |doc| docs << doc })
+    assert_equal(expect, docs)
+    assert_equal(expect, p.each(StringIO.new(json)).to_a)
+    assert_equal([[1]], p.each('[1] [2').first(1))
+    e = assert_raises(EncodingError) { p.each(StringIO.new("[1]\n [2")) { |doc| } }
+    assert_match(/not closed at 2:4/, e.message)
+    # Errors from the block are not mistaken for the end of the stream.
+    assert_raises(EOFError) { p.each(StringIO.new('[1] [2]')) { |doc| raise EOFError } }
+    assert_equal([1], p.parse('[1]'))
+  end
+
+  def test_feed
+    p = Oj::Parser.new(:usual)
+    json = %|{"a":[1,2.5,"x\\u00e9y"],"b":{"c":null}} 123 "str" 4.5e1|
+    docs = []
+    json.each_char { |c| p.feed(c) { |doc| docs << doc } }
+    p.finish { |doc| docs << doc }
+    assert_equal([{'a' => [1, 2.5, 'xéy'], 'b' => {'c' => nil}}, 123, 'str', 45.0], docs)
+
+    assert_equal({'a' => [1, 2]}, p.feed('{"a":').feed('[1,').feed('2]}').finish)
+    p.feed('[1,')
+    e = assert_raises(EncodingError) { p.finish }
+    assert_match(/not closed at 1:4/, e.message)
+    assert_raises(EncodingError) { p.feed('[1,}') }
+    # A new stream is started after an error.
+    assert_equal([3], p.feed('[3]').finish)
+  end
+
+  def test_release_gvl
+    obj = (0...200).map { |i| {'id' => i, 'name' => "né #{i}", 'v' => [1.5, nil, true, 12345678901234567890]} }
+    json = Oj.dump(obj, mode: :strict)
+    p = Oj::Parser.new(:usual, release_gvl: 1024)
+    assert_equal(1024, p.release_gvl)
+    assert_equal(obj, p.parse(json))
+    assert_equal([1, 2], p.parse('[1,2]'))
+    threads = (0...3).map { Thread.new { Oj::Parser.new(:usual, release_gvl: 1024).parse(json) } }
+    threads.each { |t| assert_equal(obj, t.value) }
+    # Longer than the scan buffers so they grow without the GVL.
+    long = {'k' * 1500 => 'v' * 3000, 'n' => ['é' * 800]}
+    assert_equal(long, p.parse(Oj.dump(long, mode: :strict)))
+    e = assert_raises(EncodingError) { p.parse("[1,\n#{' ' * 2000}}") }
+    assert_match(/at 2:2001/, e.message)
+    p.just_one = true
+    assert_raises(EncodingError) { p.parse("[1]#{' ' * 2000}[2]") }
+  end
+
+  def test_release_gvl_interrupt
+    json = Oj.dump((0...200_000).map { |i| [i, 'abc', true, nil] }, mode: :strict)
+    p = Oj::Parser.new(:validate, release_gvl: 1024)
+    th = Thread.new { p.parse(json) }
+    th.report_on_exception = false
+    sleep 0.01
+    th.raise(RuntimeError, 'stop')
+    assert_raises(RuntimeError) { th.join }
+    # The tape is given back so the parser still works.
+    assert_nil(p.parse(json))
+  end
+
+  def test_io_buffer
+    skip 'IO::Buffer not available' unless defined?(IO::Buffer)
+    p = Oj::Parser.new(:usual)
+    buf = IO::Buffer.for('[1,2] {"a":true}')
+    assert_equal([1, 2], p.parse(buf, 0))
+    assert_equal(6, p.consumed)
+    assert_equal({'a' => true}, p.parse(buf, 6))
+  end
+
   def test_capacity
     p = Oj::Parser.new(:usual, capacity: 1000)
     assert_equal(4096, p.capacity)
@@ -114,6 +447,25 @@ class UsualTest < Minitest::Test
     assert_equal(Float, doc.class)
   end
 
+  def test_float_rounding
+    p = Oj::Parser.new(:usual)
+    %w[
+      0.1 0.3 1e23 -52.605645588168e-196 8.98846567431158e307 5e-324 2.225073858507201e-308 -0.0
+    ].each { |s|
+      assert(Float(s).eql?(p.parse(s)), s)
+    }
+    assert_equal(Float::INFINITY, p.parse('1e400'))
+    assert_equal(0.0, p.parse('1e-400'))
+
+    p.decimal = :float
+    %w[
+      1.234567890123456789 -0.0034776585974550657 192.33800000000002 12345678901234567890123
+      2.2250738585072014e-308 4.9406564584124654e-324 1.7976931348623157e308 7.2057594037927933e16
+    ].each { |s|
+      assert(Float(s).eql?(p.parse(s)), s)
+    }
+  end
+
   def test_omit_null
     p = Oj::Parser.new(:usual)
     p.omit_null = true
@@ -134,6 +486,23 @@ class UsualTest < Minitest::Test
     assert_equal(MyArray, p.array_class)
     doc = p.parse('[true]')
     assert_equal(MyArray, doc.class)
+    doc = p.parse('[1,[2,3]]')
+    assert_equal([1, [2, 3]], doc)
+    assert_equal(MyArray, doc[1].class)
+
+    p.array_class = MyCountArray
+    doc = p.parse('[1,2,3]')
+    assert_equal([1, 2, 3], doc)
+    assert_equal(3, doc.pushed)
+  end
+
+  class MyCountArray < Array
+    attr_reader :pushed
+
+    def <<(v)
+      @pushed = (@pushed || 0) + 1
+      super
+    end
   end
 
   class MyHash < Hash
@@ -145,6 +514,18 @@ class UsualTest < Minitest::Test
     assert_equal(MyHash, p.hash_class)
     doc = p.parse('{"a":true}')
     assert_equal(MyHash, doc.class)
+    doc = p.parse('{"a":1,"b":{"c":2},"d":3,"e":4,"f":5,"g":6,"h":7,"i":8,"j":9}')
+    assert_equal({'a' => 1, 'b' => {'c' => 2}, 'd' => 3, 'e' => 4, 'f' => 5, 'g' => 6, 'h' => 7, 'i' => 8, 'j' => 9}, doc)
+    assert_equal(MyHash, doc['b'].class)
+
+    p.hash_class = MyUpHash
+    assert_equal({'A' => 1, 'B' => {'C' => 2}}, p.parse('{"a":1,"b":{"c":2}}'))
+  end
+
+  class MyUpHash < Hash
+    def []=(k, v)
+      super(k.upcase, v)
+    end
   end
 
   class MyClass
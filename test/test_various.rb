@@ -738,6 +738,50 @@ class Juice < Minitest::Test
     assert_equal(%|{"x":{"a":1}}|, json)
   end
 
+  def test_cache_stats
+    Oj.load(%|{"cache_stats_key":1}|, mode: :strict, cache_keys: true)
+    before = Oj.cache_stats
+    Oj.load(%|{"cache_stats_key":1}|, mode: :strict, cache_keys: true)
+    stats = Oj.cache_stats
+    assert_equal([:str, :sym, :attr, :class], stats.keys)
+    stats.each_value { |s|
+      assert_equal([:size, :count, :hits, :misses, :rehashes, :expunged, :retired, :permanent, :bytes], s.keys)
+      assert(s[:count] <= s[:size])
+      assert(0 < s[:bytes])
+    }
+    assert_equal(before[:str][:hits] + 1, stats[:str][:hits])
+    assert_equal(before[:str][:misses], stats[:str][:misses])
+  end
+
+  def test_register_keys
+    Oj.register_keys(['reg_one', :reg_two, 'reg_one'])
+    keys = Oj.registered_keys
+    assert(keys.include?('reg_one'))
+    assert(keys.include?('reg_two'))
+    assert_equal(keys.uniq.size, keys.size)
+    k1 = Oj.load(%|{"reg_one":1}|, mode: :strict, cache_keys: true).keys[0]
+    GC.start
+    k2 = Oj.load(%|{"reg_one":1}|, mode: :strict, cache_keys: true).keys[0]
+    assert(k1.equal?(k2))
+
+    Oj.register_keys(['reg_sym'], symbols: true)
+    assert(Oj.registered_keys(symbols: true).include?('reg_sym'))
+    assert_equal({reg_sym: 1}, Oj.load(%|{"reg_sym":1}|, mode: :strict, symbol_keys: true))
+
+    assert_raises(TypeError) { Oj.register_keys([1]) }
+    assert_raises(ArgumentError) { Oj.register_keys(['x' * 2000]) }
+  end
+
+  def test_save_load_keys
+    Oj.register_keys(%w[saved_one saved_two])
+    Tempfile.create('oj_keys') { |f|
+      Oj.save_keys(f.path)
+      assert_equal(Oj.registered_keys.sort, Oj.load_file(f.path).sort)
+      Oj.load_keys(f.path, symbols: true)
+      assert(Oj.registered_keys(symbols: true).include?('saved_two'))
+    }
+  end
+
   def dump_and_load(obj, trace=false)
     json = Oj.dump(obj, :indent => 2)
     puts json if trace